@@ -1,14 +1,28 @@
 #include "benchmark.h"
 
+#include <algorithm>
+#include <chrono>
 #include <execution>
 #include <iostream>
+#include <list>
+#include <memory>
+#include <numeric>
 #include <random>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "concurrent_map.h"
 #include "log_duration.h"
+#include "posting_codec.h"
+#include "lsm_search_server.h"
 #include "search_server.h"
+#include "segmented_search_server.h"
+#include "string_processing.h"
+#include "thread_pool.h"
 #include "process_queries.h"
+#include "remove_duplicates.h"
 
 using namespace std;
 
@@ -81,6 +95,27 @@ vector<string> GenerateQueries(mt19937& generator, const vector<string>& diction
     return queries;
 }
 
+// Текст с частотами слов по закону Ципфа: слово с рангом r встречается с вероятностью ~1/r
+string GenerateZipfText(mt19937& generator, const vector<string>& dictionary, int word_count) {
+    static vector<double> weights;
+    if (weights.size() != dictionary.size()) {
+        weights.clear();
+        for (size_t rank = 1; rank <= dictionary.size(); ++rank) {
+            weights.push_back(1.0 / rank);
+        }
+    }
+    discrete_distribution<size_t> distribution(weights.begin(), weights.end());
+
+    string text;
+    for (int i = 0; i < word_count; ++i) {
+        if (!text.empty()) {
+            text.push_back(' ');
+        }
+        text += dictionary[distribution(generator)];
+    }
+    return text;
+}
+
 vector<string> GenerateQueriesWithMinus(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
     vector<string> queries;
     queries.reserve(query_count);
@@ -100,6 +135,25 @@ void Test(string_view mark, QueriesProcessor processor, const SearchServer& sear
 
 #define TEST1(processor) Test(#processor, processor, search_server, queries)
 
+// Прежняя схема: каждый запрос вычисляется отдельно
+vector<vector<Document>> ProcessQueriesIndependently(const SearchServer& search_server, const vector<string>& queries) {
+    vector<vector<Document>> documents_lists(queries.size());
+    transform(execution::par, queries.begin(), queries.end(), documents_lists.begin(),
+        [&search_server](string_view query) { return search_server.FindTopDocuments(query); });
+    return documents_lists;
+}
+
+// Прежнее объединение выдач: по узлу списка на документ
+list<Document> ProcessQueriesJoinedToList(const SearchServer& search_server, const vector<string>& queries) {
+    list<Document> found_documents;
+    for (auto& documents : ProcessQueries(search_server, queries)) {
+        for (auto& document : documents) {
+            found_documents.push_back(document);
+        }
+    }
+    return found_documents;
+}
+
 void BenchmarkProcessQueries() {
     SearchServer search_server("and with"s);
 
@@ -112,7 +166,25 @@ void BenchmarkProcessQueries() {
     }
 
     const auto queries = GenerateQueries(generator, dictionary, 2'000, 7);
+    TEST1(ProcessQueriesIndependently);
     TEST1(ProcessQueries);
+    TEST1(ProcessQueriesJoinedToList);
+    TEST1(ProcessQueriesJoined);
+
+    // Слова с частотами по закону Ципфа: у запросов пакета много общих частых слов
+    {
+        SearchServer search_server("and with"s);
+        for (int i = 0; i < 20'000; ++i) {
+            search_server.AddDocument(i, GenerateZipfText(generator, dictionary, 50), DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+        vector<string> queries;
+        for (int i = 0; i < 2'000; ++i) {
+            queries.push_back(GenerateZipfText(generator, dictionary, 7));
+        }
+        cout << "Zipf corpus"s << endl;
+        TEST1(ProcessQueriesIndependently);
+        TEST1(ProcessQueries);
+    }
 }
 
 // ----- Проверка RemoveDocument -----
@@ -197,7 +269,37 @@ void Test(string_view mark, SearchServer search_server, const string& query, Exe
     cout << word_count << endl;
 }
 
+// Запрос разобран один раз до замера
+template <typename ExecutionPolicy>
+void Test(string_view mark, const SearchServer& search_server, const PreparedQuery& query, ExecutionPolicy&& policy) {
+
+    const int document_count = search_server.GetDocumentCount();
+    int word_count = 0;
+    {
+        LOG_DURATION(mark);
+        for (int id = 0; id < document_count; ++id) {
+            const auto [words, status] = search_server.MatchDocument(policy, query, id);
+            word_count += words.size();
+        }
+    }
+    cout << word_count << endl;
+}
+
+// Все документы проверяются одним вызовом MatchDocuments
+template <typename ExecutionPolicy>
+void Test(string_view mark, const SearchServer& search_server, const string& query, const vector<int>& document_ids, ExecutionPolicy&& policy) {
+
+    size_t word_count = 0;
+    {
+        LOG_DURATION(mark);
+        const DocumentMatches matches = search_server.MatchDocuments(policy, query, document_ids);
+        word_count = matches.word_indices.size();
+    }
+    cout << word_count << endl;
+}
+
 #define TEST3(policy) Test(#policy, search_server, query, execution::policy)
+#define TEST3_1(policy) Test("prepared "s + #policy, search_server, prepared_query, execution::policy)
 
 void BenchmarkMatchDocument() {
     mt19937 generator;
@@ -214,6 +316,15 @@ void BenchmarkMatchDocument() {
 
     TEST3(seq);
     TEST3(par);
+
+    const PreparedQuery prepared_query = search_server.PrepareQuery(query);
+    TEST3_1(seq);
+    TEST3_1(par);
+
+    vector<int> document_ids(search_server.GetDocumentCount());
+    iota(document_ids.begin(), document_ids.end(), 0);
+    Test("batch seq"s, search_server, query, document_ids, execution::seq);
+    Test("batch par"s, search_server, query, document_ids, execution::par);
 }
 
 
@@ -252,4 +363,435 @@ void BenchmarkFindTopDocuments() {
 
     TEST4(seq);
     TEST4(par);
+
+    // Параллельная версия на собственном пуле потоков вместо std::execution::par
+    search_server.SetThreadPool(make_shared<ThreadPool>());
+    Test("par thread pool"s, search_server, queries, execution::par);
+}
+
+// ----- Проверка сегментированного индекса -----
+
+void BenchmarkSegmentedIndex(size_t corpus_scale) {
+    cout << "Benchmark segmented index, documents: "s << 10'000 * corpus_scale << endl;
+
+    // Корпус BenchmarkFindTopDocuments, увеличенный в corpus_scale раз. Документы
+    // порождаются заново для каждого количества сегментов, чтобы не держать
+    // в памяти тексты и несколько индексов сразу
+    for (const size_t segment_count : { 1u, 2u, 4u, 8u, 16u }) {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionaryNotSorted(generator, 1000, 10);
+        SegmentedSearchServer search_server(dictionary[0], segment_count);
+        for (size_t i = 0; i < 10'000 * corpus_scale; ++i) {
+            search_server.AddDocument(i, GenerateQueryWithMinus(generator, dictionary, 70), DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+
+        const auto queries = GenerateQueriesWithMinus(generator, dictionary, 100, 70);
+        double total_relevance = 0;
+        {
+            LOG_DURATION("segments "s + to_string(segment_count));
+            for (const string_view query : queries) {
+                for (const auto& document : search_server.FindTopDocuments(execution::par, query)) {
+                    total_relevance += document.relevance;
+                }
+            }
+        }
+        cout << total_relevance << endl;
+    }
+}
+
+// ----- Проверка индекса с memtable и запечатанными сегментами -----
+
+// Запись документов вперемешку с поиском: после каждых query_period документов
+// выполняется запрос. Выводит общее время и наибольшее время одного шага
+template <typename Server>
+void TestIngest(string_view mark, Server& search_server, const vector<string>& documents,
+    const vector<string>& queries, size_t query_period) {
+    double total_relevance = 0;
+    chrono::steady_clock::duration max_step_duration{};
+    {
+        LOG_DURATION(mark);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            const auto step_start = chrono::steady_clock::now();
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+            if (i % query_period == 0) {
+                for (const auto& document : search_server.FindTopDocuments(execution::par, queries[i / query_period % queries.size()])) {
+                    total_relevance += document.relevance;
+                }
+            }
+            max_step_duration = max(max_step_duration, chrono::steady_clock::now() - step_start);
+        }
+    }
+    cout << total_relevance << ", max step: "s << chrono::duration_cast<chrono::microseconds>(max_step_duration).count() << " us"s << endl;
+}
+
+void BenchmarkLsmIndex() {
+    cout << "Benchmark LSM index" << endl;
+    mt19937 generator;
+
+    const auto dictionary = GenerateDictionaryNotSorted(generator, 1000, 10);
+    const auto documents = GenerateQueriesWithMinus(generator, dictionary, 50'000, 70);
+    const auto queries = GenerateQueriesWithMinus(generator, dictionary, 100, 10);
+
+    // Монолитный индекс вливает буфер записи во весь CSR при каждом поиске после записи
+    {
+        SearchServer search_server(dictionary[0]);
+        TestIngest("monolithic"s, search_server, documents, queries, 100);
+    }
+    {
+        LsmSearchServer search_server(dictionary[0]);
+        TestIngest("lsm"s, search_server, documents, queries, 100);
+    }
+
+    // Задержка поиска без записи и во время потока записей из другого потока.
+    // Поиск читает неизменяемый снимок индекса и записей не ждет; на одном ядре
+    // поиск и запись делят процессор
+    LsmSearchServer search_server(dictionary[0]);
+    const size_t half = documents.size() / 2;
+    for (size_t i = 0; i < half; ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+    search_server.WaitForMerge();
+
+    auto run_queries = [&](string_view mark) {
+        double total_relevance = 0;
+        chrono::steady_clock::duration max_query_duration{};
+        {
+            LOG_DURATION(mark);
+            for (const string& query : queries) {
+                const auto query_start = chrono::steady_clock::now();
+                for (const auto& document : search_server.FindTopDocuments(execution::par, query)) {
+                    total_relevance += document.relevance;
+                }
+                max_query_duration = max(max_query_duration, chrono::steady_clock::now() - query_start);
+            }
+        }
+        cout << total_relevance << ", max query: "s << chrono::duration_cast<chrono::microseconds>(max_query_duration).count() << " us"s << endl;
+    };
+
+    run_queries("queries without writes"s);
+    thread writer([&] {
+        for (size_t i = half; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+    });
+    run_queries("queries during writes"s);
+    writer.join();
+}
+
+// ----- Проверка пакетного добавления документов -----
+
+void BenchmarkAddDocuments(size_t document_count) {
+    cout << "Benchmark AddDocuments, documents: "s << document_count << endl;
+    mt19937 generator;
+
+    const auto dictionary = GenerateDictionaryNotSorted(generator, 10'000, 10);
+    vector<string> texts;
+    texts.reserve(document_count);
+    for (size_t i = 0; i < document_count; ++i) {
+        texts.push_back(GenerateZipfText(generator, dictionary, 50));
+    }
+    vector<DocumentInput> documents;
+    documents.reserve(document_count);
+    for (size_t i = 0; i < document_count; ++i) {
+        documents.push_back({ static_cast<int>(i), texts[i], DocumentStatus::ACTUAL, { 1, 2, 3 } });
+    }
+
+    // В замер входит первый поиск: он вливает буфер записи в индекс
+    const string query = dictionary[0] + " "s + dictionary[100] + " "s + dictionary[5000];
+    auto finish = [&query](const SearchServer& search_server) {
+        cout << search_server.FindTopDocuments(query).size() << endl;
+    };
+
+    {
+        SearchServer search_server(""s);
+        LOG_DURATION("AddDocument"s);
+        for (const DocumentInput& document : documents) {
+            search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+        finish(search_server);
+    }
+    {
+        SearchServer search_server(""s);
+        LOG_DURATION("AddDocuments seq"s);
+        search_server.AddDocuments(execution::seq, documents);
+        finish(search_server);
+    }
+    {
+        SearchServer search_server(""s);
+        LOG_DURATION("AddDocuments par"s);
+        search_server.AddDocuments(execution::par, documents);
+        finish(search_server);
+    }
+    {
+        SearchServer search_server(""s);
+        search_server.SetThreadPool(make_shared<ThreadPool>());
+        LOG_DURATION("AddDocuments par thread pool"s);
+        search_server.AddDocuments(execution::par, documents);
+        finish(search_server);
+    }
+}
+
+// ----- Проверка пакетного удаления -----
+
+void BenchmarkRemoveDocuments(size_t document_count) {
+    cout << "Benchmark RemoveDocuments, documents: "s << document_count << endl;
+    mt19937 generator;
+
+    const auto dictionary = GenerateDictionaryNotSorted(generator, 10'000, 10);
+    vector<string> texts;
+    texts.reserve(document_count);
+    for (size_t i = 0; i < document_count; ++i) {
+        texts.push_back(GenerateZipfText(generator, dictionary, 50));
+    }
+    vector<DocumentInput> documents;
+    documents.reserve(document_count);
+    for (size_t i = 0; i < document_count; ++i) {
+        documents.push_back({ static_cast<int>(i), texts[i], DocumentStatus::ACTUAL, { 1, 2, 3 } });
+    }
+
+    SearchServer base_server(""s);
+    base_server.SetPostingFormat(PostingFormat::COMPRESSED);
+    base_server.AddDocuments(execution::par, documents);
+
+    // В замер входит первый поиск: он вливает удаления, отложенные RemoveDocument
+    const string query = dictionary[0] + " "s + dictionary[100] + " "s + dictionary[5000];
+    auto finish = [&query](const SearchServer& search_server) {
+        cout << search_server.FindTopDocuments(query).size() << endl;
+    };
+
+    // Удаления вперемешку с поиском: каждый поиск должен учесть только что
+    // удаленный документ. Запрос из редких слов, чтобы время поиска не
+    // заслоняло стоимость удаления
+    {
+        SearchServer search_server = base_server;
+        const string rare_query = dictionary[5000] + " "s + dictionary[9000];
+        size_t found_count = 0;
+        LOG_DURATION("RemoveDocument + FindTopDocuments"s);
+        for (size_t i = 0; i < 2'000; ++i) {
+            search_server.RemoveDocument(static_cast<int>(i * 7919 % document_count));
+            found_count += search_server.FindTopDocuments(rare_query).size();
+        }
+        cout << found_count << endl;
+    }
+
+    // Удаляется каждый divisor-й документ в среднем, вразброс
+    for (const unsigned divisor : { 3u, 100u }) {
+        vector<int> removed_ids;
+        for (size_t i = 0; i < document_count; ++i) {
+            if (generator() % divisor == 0) {
+                removed_ids.push_back(static_cast<int>(i));
+            }
+        }
+        cout << "Removed: "s << removed_ids.size() << endl;
+
+        {
+            SearchServer search_server = base_server;
+            LOG_DURATION("RemoveDocument"s);
+            for (const int id : removed_ids) {
+                search_server.RemoveDocument(id);
+            }
+            finish(search_server);
+        }
+        {
+            SearchServer search_server = base_server;
+            LOG_DURATION("RemoveDocuments seq"s);
+            search_server.RemoveDocuments(execution::seq, removed_ids);
+            finish(search_server);
+        }
+        {
+            SearchServer search_server = base_server;
+            LOG_DURATION("RemoveDocuments par"s);
+            search_server.RemoveDocuments(execution::par, removed_ids);
+            finish(search_server);
+        }
+        {
+            SearchServer search_server = base_server;
+            search_server.SetThreadPool(make_shared<ThreadPool>());
+            LOG_DURATION("RemoveDocuments par thread pool"s);
+            search_server.RemoveDocuments(execution::par, removed_ids);
+            finish(search_server);
+        }
+    }
+}
+
+// ----- Проверка удаления дубликатов -----
+
+void BenchmarkRemoveDuplicates(size_t document_count) {
+    cout << "Benchmark RemoveDuplicates, documents: "s << document_count << endl;
+    mt19937 generator;
+
+    // Примерно каждый пятый документ повторяет набор слов одного из
+    // предыдущих в другом порядке
+    const auto dictionary = GenerateDictionaryNotSorted(generator, 10'000, 10);
+    vector<string> texts;
+    texts.reserve(document_count);
+    for (size_t i = 0; i < document_count; ++i) {
+        if (i > 0 && generator() % 5 == 0) {
+            vector<string_view> words = SplitIntoWords(texts[generator() % i]);
+            shuffle(words.begin(), words.end(), generator);
+            string text;
+            for (const string_view word : words) {
+                text += word;
+                text += ' ';
+            }
+            texts.push_back(move(text));
+        }
+        else {
+            texts.push_back(GenerateZipfText(generator, dictionary, 10));
+        }
+    }
+    vector<DocumentInput> documents;
+    documents.reserve(document_count);
+    for (size_t i = 0; i < document_count; ++i) {
+        documents.push_back({ static_cast<int>(i), texts[i], DocumentStatus::ACTUAL, { 1, 2, 3 } });
+    }
+
+    SearchServer search_server(""s);
+    search_server.AddDocuments(execution::par, documents);
+
+    ostringstream out;
+    {
+        LOG_DURATION("RemoveDuplicates"s);
+        RemoveDuplicates(search_server, out);
+    }
+    cout << "Removed: "s << document_count - search_server.GetDocumentCount() << endl;
+}
+
+// ----- Проверка отсечения документов при поиске -----
+
+void Test(string_view mark, const SearchServer& search_server, const vector<string>& queries, const SearchOptions& options) {
+    double total_relevance = 0;
+    {
+        LOG_DURATION(mark);
+        for (const string_view query : queries) {
+            for (const auto& document : search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options)) {
+                total_relevance += document.relevance;
+            }
+        }
+    }
+    cout << total_relevance << endl;
+}
+
+void BenchmarkPrunedRetrieval() {
+    mt19937 generator;
+
+    // Корпус с распределением Ципфа: несколько частых слов и длинный хвост редких
+    const auto dictionary = GenerateDictionaryNotSorted(generator, 10'000, 10);
+    SearchServer search_server(""s);
+    for (int i = 0; i < 50'000; ++i) {
+        search_server.AddDocument(i, GenerateZipfText(generator, dictionary, uniform_int_distribution(10, 100)(generator)),
+            DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+
+    vector<string> queries;
+    for (int i = 0; i < 100; ++i) {
+        queries.push_back(GenerateZipfText(generator, dictionary, 70));
+    }
+
+    const SearchOptions exhaustive{ MAX_RESULT_DOCUMENT_COUNT, EvaluationMode::EXHAUSTIVE };
+    const SearchOptions max_score{ MAX_RESULT_DOCUMENT_COUNT, EvaluationMode::MAX_SCORE };
+    const SearchOptions block_max_score{ MAX_RESULT_DOCUMENT_COUNT, EvaluationMode::BLOCK_MAX_SCORE };
+    Test("exhaustive"s, search_server, queries, exhaustive);
+    Test("max score"s, search_server, queries, max_score);
+
+    // Подбор размера блока оценок
+    for (const size_t block_size : { 8, 16, 32, 64, 128, 256 }) {
+        search_server.SetScoreBlockSize(block_size);
+        cout << "block " << block_size << ", index bytes: "s << search_server.GetIndexByteSize() << endl;
+        Test("block max score"s, search_server, queries, block_max_score);
+    }
+}
+
+// ----- Проверка сжатия списков документов -----
+
+void BenchmarkPostingCodec() {
+    mt19937 generator;
+
+    // Возрастающие номера документов со средним шагом 8, как в частых словах
+    const size_t value_count = 10'000'000;
+    vector<uint32_t> ordinals(value_count);
+    uint32_t ordinal = 0;
+    for (auto& value : ordinals) {
+        ordinal += uniform_int_distribution<uint32_t>(1, 15)(generator);
+        value = ordinal;
+    }
+
+    vector<uint32_t> deltas = ordinals;
+    EncodeDeltas(deltas.data(), deltas.size(), 0);
+    vector<uint8_t> encoded;
+    EncodeStreamVByte(deltas.data(), deltas.size(), encoded);
+    encoded.resize(encoded.size() + STREAM_VBYTE_PADDING);
+    cout << "Encoded bytes per posting: "s << (encoded.size() * 1.0 / value_count) << endl;
+
+    vector<uint32_t> decoded(value_count);
+    {
+        LOG_DURATION("decode scalar"s);
+        DecodeStreamVByteScalar(encoded.data(), value_count, decoded.data());
+        DecodeDeltas(decoded.data(), value_count, 0);
+    }
+    {
+        LOG_DURATION(IsSimdDecodingAvailable() ? "decode simd"s : "decode simd (unavailable, scalar)"s);
+        DecodeStreamVByte(encoded.data(), value_count, decoded.data());
+        DecodeDeltas(decoded.data(), value_count, 0);
+    }
+    cout << (decoded == ordinals ? "round trip ok"s : "round trip FAILED"s) << endl;
+
+    // Размер индекса и время поиска в обоих форматах
+    const auto dictionary = GenerateDictionaryNotSorted(generator, 1000, 10);
+    const auto documents = GenerateQueriesWithMinus(generator, dictionary, 10'000, 70);
+    const auto queries = GenerateQueriesWithMinus(generator, dictionary, 100, 70);
+
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+
+    for (const PostingFormat format : { PostingFormat::RAW, PostingFormat::COMPRESSED }) {
+        search_server.SetPostingFormat(format);
+        const string mark = format == PostingFormat::RAW ? "raw"s : "compressed"s;
+        cout << mark << " index bytes: "s << search_server.GetIndexByteSize() << endl;
+        Test(mark, search_server, queries, execution::seq);
+    }
+}
+
+
+// ----- Проверка конкурентного доступа к ConcurrentMap -----
+
+// Каждый поток прибавляет к случайным ключам; update задает способ прибавления
+template <typename Update>
+void Test(string_view mark, int thread_count, const vector<int>& keys, Update update) {
+    LOG_DURATION(mark);
+    vector<thread> threads;
+    for (int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&keys, &update, t, thread_count]() {
+            for (size_t i = t; i < keys.size(); i += thread_count) {
+                update(keys[i]);
+            }
+        });
+    }
+    for (auto& worker : threads) {
+        worker.join();
+    }
+}
+
+void BenchmarkConcurrentMap() {
+    mt19937 generator;
+    vector<int> keys(4'000'000);
+    for (int& key : keys) {
+        key = uniform_int_distribution(0, 100'000)(generator);
+    }
+
+    for (const int thread_count : { 1, 2, 4, 8, 16 }) {
+        for (const size_t bucket_count : { 1, 4, 16, 64, 256 }) {
+            const string mark = "threads "s + to_string(thread_count) + ", buckets "s + to_string(bucket_count);
+            {
+                ConcurrentMap<int, double> map(bucket_count);
+                Test(mark + ", lock"s, thread_count, keys, [&map](int key) { map[key].ref_to_value += 1.0; });
+            }
+            {
+                ConcurrentMap<int, double> map(bucket_count);
+                Test(mark + ", fetch add"s, thread_count, keys, [&map](int key) { map.FetchAdd(key, 1.0); });
+            }
+        }
+    }
 }
\ No newline at end of file
@@ -1,6 +1,16 @@
 #pragma once
+#include <cstddef>
 
 void BenchmarkProcessQueries();
 void BenchmarkRemoveDocument();
 void BenchmarkMatchDocument();
-void BenchmarkFindTopDocuments();
\ No newline at end of file
+void BenchmarkFindTopDocuments();
+// corpus_scale - во сколько раз корпус больше, чем в BenchmarkFindTopDocuments
+void BenchmarkSegmentedIndex(size_t corpus_scale = 100);
+void BenchmarkLsmIndex();
+void BenchmarkAddDocuments(size_t document_count = 5'000'000);
+void BenchmarkRemoveDocuments(size_t document_count = 1'000'000);
+void BenchmarkRemoveDuplicates(size_t document_count = 2'000'000);
+void BenchmarkPrunedRetrieval();
+void BenchmarkPostingCodec();
+void BenchmarkConcurrentMap();
\ No newline at end of file
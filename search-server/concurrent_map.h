@@ -1,25 +1,48 @@
 #pragma once
 
-#include <algorithm>
-#include <cstdlib>
-#include <future>
-#include <map>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
 #include <mutex>
-#include <numeric>
-#include <random>
-#include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+// Размер строки кэша. Подсловари выравниваются по нему, чтобы мьютексы
+// соседних подсловарей не делили одну строку (false sharing)
+const size_t CONCURRENT_MAP_CACHE_LINE_SIZE = 64;
 
 template <typename Key, typename Value>
 class ConcurrentMap {
 private:
-    // Бликируемый подсловарь. Определяется в начале класса для
-    // последующего использования
-    struct Bucket {
-        // Для оптимизации памяти указываем mutex в начале
+    // Ячейка хеш-таблицы с открытой адресацией. Значения лежат отдельно и не
+    // перемещаются при росте таблицы, ячейка хранит указатель на значение.
+    // Ненулевой указатель публикует ячейку: ключ записывается до него
+    struct Slot {
+        Key key{};
+        std::atomic<Value*> value{ nullptr };
+    };
+
+    // Таблица подсловаря с линейным пробированием, размер - степень двойки
+    struct Table {
+        explicit Table(size_t capacity)
+            : mask(capacity - 1)
+            , slots(new Slot[capacity]) {
+        }
+
+        size_t mask;
+        std::unique_ptr<Slot[]> slots;
+    };
+
+    // Подсловарь. Вставка и рост таблицы выполняются под мьютексом. Старые таблицы
+    // не удаляются до Drain: их могут читать потоки на пути FetchAdd без блокировки
+    struct alignas(CONCURRENT_MAP_CACHE_LINE_SIZE) Bucket {
         std::mutex m_;
-        std::map<Key, Value> part_;
+        std::atomic<Table*> table_{ nullptr };
+        std::vector<std::unique_ptr<Table>> tables_;
+        std::deque<Value> values_;
+        size_t size_ = 0;
     };
 
 public:
@@ -38,17 +61,20 @@ public:
 
         // Конструктор структуры для получения ссылки значения из ссылки на
         // подсловарь
-        Access(const Key& key, Bucket& bucket) :
+        Access(const Key& key, uint64_t hash, Bucket& bucket) :
             // Блокируем доступ к подсловарю из других потоков
             guard(bucket.m_),
             // Определяем ссылку на значение из подсловаря для key
-            ref_to_value(bucket.part_[key]) {
+            ref_to_value(FindOrInsert(bucket, key, hash)) {
         }
     };
 
     // Конструктор класса ConcurrentMap<Key, Value> принимает количество подсловарей,
     // на которые надо разбить всё пространство ключей
-    explicit ConcurrentMap(size_t bucket_count) : buckets_(bucket_count) {}
+    explicit ConcurrentMap(size_t bucket_count)
+        : bucket_count_(bucket_count)
+        , buckets_(new Bucket[bucket_count]) {
+    }
 
     // operator[] должен вести себя так же, как аналогичный оператор у map:
     // если ключ key есть в словаре, должен возвращаться объект класса Access,
@@ -56,43 +82,167 @@ public:
     // в него надо добавить пару (key, Value()) и вернуть объект класса Access,
     // содержащий ссылку на только что добавленное значение.
     Access operator[](const Key& key) {
-        // Определяем к какому субсловарю относится ключ. Для этого проводим операцию
-        // взятия остатка от деления. Остаток от деления показывает к какой группе
-        // от 0 до buckets_.size()-1 относится ключ. Чтобы не учитывать "-" приводим
-        // ключ к uint64_t, тем самым делая его просто большим положительным числом.
-        // В результатет общий порядок ключей векторе мапов будет не сортирован, но в
-        // самих map будет сортировка 
-        auto bucket_index = static_cast<uint64_t>(key) % buckets_.size();
-
-        // Получаем ссылку на подсловарь по индексу
-        auto& bucket = buckets_[bucket_index];
-
-        // Возвращаем ссылки на подсловарь и ключ
-        return { key, bucket }; //Access to map key;
+        const uint64_t hash = Hash(key);
+        return { key, hash, GetBucket(hash) };
     }
 
+    // Атомарное прибавление delta к значению ключа (для арифметических Value).
+    // Уже существующий ключ находится и обновляется без блокировки, мьютекс
+    // подсловаря берется только для вставки нового ключа. Одновременно с FetchAdd
+    // тот же ключ нельзя менять через operator[]
+    void FetchAdd(const Key& key, Value delta) {
+        static_assert(std::is_arithmetic_v<Value>, "FetchAdd supports only arithmetic values");
+
+        const uint64_t hash = Hash(key);
+        Bucket& bucket = GetBucket(hash);
+#if defined(__GNUC__)
+        if (Value* value = Find(bucket, key, hash)) {
+            AtomicAdd(*value, delta);
+            return;
+        }
+        std::lock_guard guard(bucket.m_);
+        AtomicAdd(FindOrInsert(bucket, key, hash), delta);
+#else
+        // Без атомарных встроенных функций компилятора обновляем под мьютексом
+        std::lock_guard guard(bucket.m_);
+        FindOrInsert(bucket, key, hash) += delta;
+#endif
+    }
 
-    // Метод BuildOrdinaryMap должен сливать вместе части словаря и возвращать
-    // весь словарь целиком. При этом он должен быть потокобезопасным,
-    // то есть корректно работать, когда другие потоки выполняют операции
-    // с ConcurrentMap.
-    std::map<Key, Value> BuildOrdinaryMap() {
-        // Промежуточный контейнер для возврата
-        std::map<Key, Value> result;
-
-        // Проходим циклом по всем субсловарям
-        for (auto& [mutex, bucket] : buckets_) {
-            // Блокируем доступ к субсловарю для други потоков
-            std::lock_guard lock(mutex);
+    // Перемещает все пары ключ-значение в вектор в произвольном порядке и очищает
+    // словарь. Вызывается после завершения записи: одновременные обращения к
+    // словарю из других потоков недопустимы
+    std::vector<std::pair<Key, Value>> Drain() {
+        std::vector<std::pair<Key, Value>> result;
 
-            // Переносим данные из подсловаря в контейнер возврата
-            result.insert(bucket.begin(), bucket.end());
+        size_t size = 0;
+        for (size_t i = 0; i < bucket_count_; ++i) {
+            size += buckets_[i].size_;
+        }
+        result.reserve(size);
+
+        for (size_t i = 0; i < bucket_count_; ++i) {
+            Bucket& bucket = buckets_[i];
+            std::lock_guard guard(bucket.m_);
+
+            const Table* table = bucket.table_.load(std::memory_order_relaxed);
+            if (table != nullptr) {
+                for (size_t slot = 0; slot <= table->mask; ++slot) {
+                    Value* value = table->slots[slot].value.load(std::memory_order_relaxed);
+                    if (value != nullptr) {
+                        result.emplace_back(table->slots[slot].key, std::move(*value));
+                    }
+                }
+            }
+
+            bucket.table_.store(nullptr, std::memory_order_relaxed);
+            bucket.tables_.clear();
+            bucket.values_.clear();
+            bucket.size_ = 0;
         }
 
         return result;
     }
 
 private:
-    // Котейнер хранения подсловарей, содержащий bucket_count частей
-    std::vector<Bucket> buckets_;
-};
\ No newline at end of file
+    static constexpr size_t INITIAL_TABLE_CAPACITY = 16;
+
+    size_t bucket_count_;
+    std::unique_ptr<Bucket[]> buckets_;
+
+    // Перемешивание битов ключа (финализатор splitmix64): последовательные
+    // ключи попадают в разные подсловари и разные ячейки
+    static uint64_t Hash(Key key) {
+        uint64_t hash = static_cast<uint64_t>(key);
+        hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+        return hash ^ (hash >> 31);
+    }
+
+    // Младшие биты хеша выбирают подсловарь, старшие - ячейку в его таблице
+    Bucket& GetBucket(uint64_t hash) {
+        return buckets_[(hash & 0xffffffffULL) % bucket_count_];
+    }
+
+    // Поиск значения без блокировки. Возвращает nullptr, если ключа нет
+    // в текущей таблице подсловаря
+    static Value* Find(const Bucket& bucket, const Key& key, uint64_t hash) {
+        const Table* table = bucket.table_.load(std::memory_order_acquire);
+        if (table == nullptr) {
+            return nullptr;
+        }
+        for (size_t slot = (hash >> 32) & table->mask;; slot = (slot + 1) & table->mask) {
+            Value* value = table->slots[slot].value.load(std::memory_order_acquire);
+            if (value == nullptr || table->slots[slot].key == key) {
+                return value;
+            }
+        }
+    }
+
+    // Поиск или вставка значения. Вызывается под мьютексом подсловаря
+    static Value& FindOrInsert(Bucket& bucket, const Key& key, uint64_t hash) {
+        if (Value* value = Find(bucket, key, hash)) {
+            return *value;
+        }
+
+        // Заполненность таблицы держим не выше половины
+        const Table* table = bucket.table_.load(std::memory_order_relaxed);
+        if (table == nullptr || (bucket.size_ + 1) * 2 > table->mask + 1) {
+            Grow(bucket);
+        }
+
+        bucket.values_.emplace_back();
+        Value* value = &bucket.values_.back();
+        Publish(*bucket.table_.load(std::memory_order_relaxed), key, hash, value);
+        ++bucket.size_;
+        return *value;
+    }
+
+    // Запись ключа в свободную ячейку таблицы
+    static void Publish(Table& table, const Key& key, uint64_t hash, Value* value) {
+        size_t slot = (hash >> 32) & table.mask;
+        while (table.slots[slot].value.load(std::memory_order_relaxed) != nullptr) {
+            slot = (slot + 1) & table.mask;
+        }
+        table.slots[slot].key = key;
+        table.slots[slot].value.store(value, std::memory_order_release);
+    }
+
+    // Создание таблицы вдвое большего размера. Значения не перемещаются,
+    // поэтому обновления через старую таблицу не теряются
+    static void Grow(Bucket& bucket) {
+        const Table* old_table = bucket.table_.load(std::memory_order_relaxed);
+        const size_t capacity = old_table == nullptr ? INITIAL_TABLE_CAPACITY : (old_table->mask + 1) * 2;
+
+        auto table = std::make_unique<Table>(capacity);
+        if (old_table != nullptr) {
+            for (size_t slot = 0; slot <= old_table->mask; ++slot) {
+                Value* value = old_table->slots[slot].value.load(std::memory_order_relaxed);
+                if (value != nullptr) {
+                    const Key key = old_table->slots[slot].key;
+                    Publish(*table, key, Hash(key), value);
+                }
+            }
+        }
+
+        bucket.table_.store(table.get(), std::memory_order_release);
+        bucket.tables_.push_back(std::move(table));
+    }
+
+#if defined(__GNUC__)
+    // Атомарное прибавление к значению, лежащему в обычной памяти
+    static void AtomicAdd(Value& target, Value delta) {
+        if constexpr (std::is_integral_v<Value>) {
+            __atomic_fetch_add(&target, delta, __ATOMIC_RELAXED);
+        }
+        else {
+            Value expected;
+            __atomic_load(&target, &expected, __ATOMIC_RELAXED);
+            Value desired = expected + delta;
+            while (!__atomic_compare_exchange(&target, &expected, &desired, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                desired = expected + delta;
+            }
+        }
+    }
+#endif
+};
@@ -1,5 +1,7 @@
 #pragma once
 #include <iostream>
+#include <string_view>
+#include <vector>
 
 struct Document {
     Document() = default;
@@ -17,4 +19,13 @@ struct Document {
 
 enum class DocumentStatus { ACTUAL, IRRELEVANT, BANNED, REMOVED, };
 
+// Документ для пакетного добавления SearchServer::AddDocuments.
+// Текст не копируется и должен жить до конца вызова
+struct DocumentInput {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
+
 std::ostream& operator<<(std::ostream& out, const Document& doc);
\ No newline at end of file
@@ -0,0 +1,192 @@
+#include "document_bitmap.h"
+
+#include <algorithm>
+#include <iterator>
+
+using namespace std;
+
+namespace {
+
+int PopCount(uint64_t word) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(word);
+#else
+    int count = 0;
+    for (; word != 0; word &= word - 1) {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+int CountTrailingZeros(uint64_t word) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(word);
+#else
+    int count = 0;
+    for (; (word & 1) == 0; word >>= 1) {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+} // namespace
+
+void DocumentBitmap::Add(int ordinal) {
+    GetChunk(static_cast<uint32_t>(ordinal) >> 16).Add(static_cast<uint16_t>(ordinal));
+}
+
+void DocumentBitmap::Remove(int ordinal) {
+    const size_t chunk = static_cast<uint32_t>(ordinal) >> 16;
+    if (chunk < chunks_.size()) {
+        chunks_[chunk].Remove(static_cast<uint16_t>(ordinal));
+    }
+}
+
+void DocumentBitmap::AddSorted(const int* ordinals, size_t count) {
+    vector<uint16_t> lows;
+    for (size_t begin = 0; begin < count;) {
+        // Отрезок номеров, попадающих в один фрагмент
+        const uint32_t chunk = static_cast<uint32_t>(ordinals[begin]) >> 16;
+        size_t end = begin;
+        lows.clear();
+        while (end < count && (static_cast<uint32_t>(ordinals[end]) >> 16) == chunk) {
+            lows.push_back(static_cast<uint16_t>(ordinals[end]));
+            ++end;
+        }
+        GetChunk(chunk).AddSorted(lows.data(), lows.size());
+        begin = end;
+    }
+}
+
+DocumentBitmap& DocumentBitmap::operator|=(const DocumentBitmap& other) {
+    for (size_t chunk = 0; chunk < other.chunks_.size(); ++chunk) {
+        if (other.chunks_[chunk].cardinality > 0) {
+            GetChunk(chunk).UnionWith(other.chunks_[chunk]);
+        }
+    }
+    return *this;
+}
+
+size_t DocumentBitmap::GetCardinality() const {
+    size_t cardinality = 0;
+    for (const Container& container : chunks_) {
+        cardinality += container.cardinality;
+    }
+    return cardinality;
+}
+
+DocumentBitmap::Container& DocumentBitmap::GetChunk(size_t chunk) {
+    if (chunk >= chunks_.size()) {
+        chunks_.resize(chunk + 1);
+    }
+    return chunks_[chunk];
+}
+
+bool DocumentBitmap::Container::Contains(uint16_t low) const {
+    if (IsBitmap()) {
+        return (bits[low >> 6] >> (low & 63)) & 1;
+    }
+    return binary_search(values.begin(), values.end(), low);
+}
+
+void DocumentBitmap::Container::Add(uint16_t low) {
+    if (IsBitmap()) {
+        const uint64_t mask = uint64_t{ 1 } << (low & 63);
+        if ((bits[low >> 6] & mask) == 0) {
+            bits[low >> 6] |= mask;
+            ++cardinality;
+        }
+        return;
+    }
+
+    const auto it = lower_bound(values.begin(), values.end(), low);
+    if (it != values.end() && *it == low) {
+        return;
+    }
+    values.insert(it, low);
+    ++cardinality;
+    if (cardinality > ARRAY_CONTAINER_MAX_SIZE) {
+        ConvertToBitmap();
+    }
+}
+
+void DocumentBitmap::Container::Remove(uint16_t low) {
+    if (IsBitmap()) {
+        const uint64_t mask = uint64_t{ 1 } << (low & 63);
+        if ((bits[low >> 6] & mask) != 0) {
+            bits[low >> 6] &= ~mask;
+            --cardinality;
+            // Обратно в массив с запасом, чтобы не перестраивать контейнер на границе
+            if (cardinality <= ARRAY_CONTAINER_MAX_SIZE / 2) {
+                ConvertToArray();
+            }
+        }
+        return;
+    }
+
+    const auto it = lower_bound(values.begin(), values.end(), low);
+    if (it != values.end() && *it == low) {
+        values.erase(it);
+        --cardinality;
+    }
+}
+
+void DocumentBitmap::Container::AddSorted(const uint16_t* lows, size_t count) {
+    // Большой отрезок сразу пишется в битовую карту
+    if (!IsBitmap() && cardinality + count > ARRAY_CONTAINER_MAX_SIZE) {
+        ConvertToBitmap();
+    }
+
+    if (IsBitmap()) {
+        for (size_t i = 0; i < count; ++i) {
+            const uint64_t mask = uint64_t{ 1 } << (lows[i] & 63);
+            cardinality += (bits[lows[i] >> 6] & mask) == 0;
+            bits[lows[i] >> 6] |= mask;
+        }
+        return;
+    }
+
+    vector<uint16_t> merged;
+    merged.reserve(values.size() + count);
+    set_union(values.begin(), values.end(), lows, lows + count, back_inserter(merged));
+    values = move(merged);
+    cardinality = values.size();
+}
+
+void DocumentBitmap::Container::UnionWith(const Container& other) {
+    if (other.IsBitmap()) {
+        if (!IsBitmap()) {
+            ConvertToBitmap();
+        }
+        cardinality = 0;
+        for (size_t i = 0; i < BITMAP_WORD_COUNT; ++i) {
+            bits[i] |= other.bits[i];
+            cardinality += PopCount(bits[i]);
+        }
+        return;
+    }
+    AddSorted(other.values.data(), other.values.size());
+}
+
+void DocumentBitmap::Container::ConvertToBitmap() {
+    bits.assign(BITMAP_WORD_COUNT, 0);
+    for (const uint16_t low : values) {
+        bits[low >> 6] |= uint64_t{ 1 } << (low & 63);
+    }
+    values.clear();
+    values.shrink_to_fit();
+}
+
+void DocumentBitmap::Container::ConvertToArray() {
+    values.clear();
+    values.reserve(cardinality);
+    for (size_t i = 0; i < BITMAP_WORD_COUNT; ++i) {
+        for (uint64_t word = bits[i]; word != 0; word &= word - 1) {
+            values.push_back(static_cast<uint16_t>(i * 64 + CountTrailingZeros(word)));
+        }
+    }
+    bits.clear();
+    bits.shrink_to_fit();
+}
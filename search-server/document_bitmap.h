@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Множество внутренних номеров документов в духе Roaring bitmap.
+// Пространство номеров разбито на фрагменты по 2^16 номеров, каждый фрагмент
+// хранится в одном из двух видов контейнера:
+//   - массив: отсортированные младшие 16 бит номеров, пока их не больше
+//     ARRAY_CONTAINER_MAX_SIZE (не больше 8 КБ);
+//   - битовая карта: 2^16 бит (8 КБ) для плотных фрагментов.
+// Внутренние номера документов плотные, поэтому фрагмент ищется прямым
+// индексированием, а не поиском по ключам, как в классическом Roaring
+class DocumentBitmap {
+public:
+    // Наибольший размер контейнера-массива. Больший фрагмент хранится битовой картой
+    static const size_t ARRAY_CONTAINER_MAX_SIZE = 4096;
+
+    void Add(int ordinal);
+    void Remove(int ordinal);
+
+    // Добавление возрастающей последовательности номеров, например списка документов слова
+    void AddSorted(const int* ordinals, size_t count);
+
+    bool Contains(int ordinal) const {
+        const size_t chunk = static_cast<uint32_t>(ordinal) >> 16;
+        if (chunk >= chunks_.size()) {
+            return false;
+        }
+        return chunks_[chunk].Contains(static_cast<uint16_t>(ordinal));
+    }
+
+    // Объединение с другим множеством
+    DocumentBitmap& operator|=(const DocumentBitmap& other);
+
+    // Количество номеров в множестве
+    size_t GetCardinality() const;
+
+    bool IsEmpty() const {
+        return GetCardinality() == 0;
+    }
+
+private:
+    static const size_t BITMAP_WORD_COUNT = (1 << 16) / 64;
+
+    // Контейнер фрагмента. Непустой bits означает битовую карту, иначе - массив values
+    struct Container {
+        std::vector<uint16_t> values;
+        std::vector<uint64_t> bits;
+        size_t cardinality = 0;
+
+        bool IsBitmap() const {
+            return !bits.empty();
+        }
+
+        bool Contains(uint16_t low) const;
+        void Add(uint16_t low);
+        void Remove(uint16_t low);
+
+        // Добавление возрастающей последовательности младших битов
+        void AddSorted(const uint16_t* lows, size_t count);
+
+        void UnionWith(const Container& other);
+
+        // Переход массив -> битовая карта и обратно по размеру контейнера
+        void ConvertToBitmap();
+        void ConvertToArray();
+    };
+
+    std::vector<Container> chunks_;
+
+    Container& GetChunk(size_t chunk);
+};
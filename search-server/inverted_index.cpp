@@ -0,0 +1,803 @@
+#include "inverted_index.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <thread>
+
+#include "posting_codec.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+InvertedIndex::InvertedIndex(const InvertedIndex& other) {
+    *this = other;
+}
+
+InvertedIndex& InvertedIndex::operator=(const InvertedIndex& other) {
+    if (this == &other) {
+        return *this;
+    }
+
+    // Уплотнение читает массивы, которые сейчас будут заменены
+    if (compaction_.valid()) {
+        compaction_.wait();
+        compaction_ = {};
+    }
+
+    // Копируем уже слитый индекс, чтобы не переносить буфер записи
+    other.Merge();
+
+    format_ = other.format_;
+    requested_format_ = other.requested_format_;
+    word_counts_ = other.word_counts_;
+    document_count_ = other.document_count_;
+    epoch_ = other.epoch_;
+    inverse_document_freqs_ = other.inverse_document_freqs_;
+    inverse_document_freqs_epoch_ = other.inverse_document_freqs_epoch_;
+    max_term_freqs_ = other.max_term_freqs_;
+    requested_score_block_size_ = other.requested_score_block_size_;
+    score_block_size_ = other.score_block_size_;
+    score_block_offsets_ = other.score_block_offsets_;
+    score_block_last_ordinals_ = other.score_block_last_ordinals_;
+    score_block_max_term_freqs_ = other.score_block_max_term_freqs_;
+    posting_offsets_ = other.posting_offsets_;
+    posting_ordinals_ = other.posting_ordinals_;
+    posting_term_freqs_ = other.posting_term_freqs_;
+    term_block_offsets_ = other.term_block_offsets_;
+    block_last_ordinals_ = other.block_last_ordinals_;
+    block_byte_offsets_ = other.block_byte_offsets_;
+    compressed_postings_ = other.compressed_postings_;
+
+    // Помеченные документы незаконченного уплотнения копия уплотнит сама
+    deleted_documents_ = other.deleted_documents_;
+    has_deleted_documents_ = other.has_deleted_documents_;
+    deleted_document_freqs_ = other.deleted_document_freqs_;
+    tombstones_ = other.tombstones_;
+    tombstones_.insert(tombstones_.end(), other.compacting_tombstones_.begin(), other.compacting_tombstones_.end());
+    tombstone_terms_ = other.tombstone_terms_;
+    tombstone_terms_.insert(tombstone_terms_.end(), other.compacting_terms_.begin(), other.compacting_terms_.end());
+    compacting_tombstones_.clear();
+    compacting_terms_.clear();
+    compaction_ratio_ = other.compaction_ratio_;
+
+    pending_postings_.clear();
+    pending_removals_.clear();
+    pending_removal_terms_.clear();
+    has_pending_.store(false, memory_order_release);
+
+    return *this;
+}
+
+InvertedIndex::~InvertedIndex() {
+    if (compaction_.valid()) {
+        compaction_.wait();
+    }
+}
+
+void InvertedIndex::AddDocument(int ordinal, int word_count, const vector<pair<int, int>>& term_counts) {
+    InstallCompaction(false);
+
+    // Документ с тем же номером ждет удаления - сначала применяем удаление,
+    // иначе при слиянии будут отброшены и новые записи
+    if (pending_removals_.count(ordinal) > 0) {
+        Merge();
+    }
+
+    if (word_counts_.size() <= static_cast<size_t>(ordinal)) {
+        word_counts_.resize(ordinal + 1, 0);
+    }
+    word_counts_[ordinal] = word_count;
+
+    for (const auto& [term_id, count] : term_counts) {
+        pending_postings_.push_back({ term_id, ordinal, static_cast<uint32_t>(count) });
+    }
+
+    ++document_count_;
+    ++epoch_;
+    has_pending_.store(true, memory_order_release);
+}
+
+void InvertedIndex::AddDocuments(int first_ordinal, const vector<int>& word_counts, vector<TermPosting> postings) {
+    InstallCompaction(false);
+
+    if (word_counts_.size() < first_ordinal + word_counts.size()) {
+        word_counts_.resize(first_ordinal + word_counts.size(), 0);
+    }
+    copy(word_counts.begin(), word_counts.end(), word_counts_.begin() + first_ordinal);
+
+    if (pending_postings_.empty()) {
+        pending_postings_ = move(postings);
+    }
+    else {
+        pending_postings_.insert(pending_postings_.end(), postings.begin(), postings.end());
+    }
+
+    document_count_ += static_cast<int>(word_counts.size());
+    ++epoch_;
+    has_pending_.store(true, memory_order_release);
+}
+
+void InvertedIndex::RemoveDocument(int ordinal, const vector<int>& term_ids) {
+    InstallCompaction(false);
+
+    deleted_documents_.Add(ordinal);
+    has_deleted_documents_ = true;
+    tombstones_.push_back(ordinal);
+    tombstone_terms_.insert(tombstone_terms_.end(), term_ids.begin(), term_ids.end());
+    for (const int term_id : term_ids) {
+        if (deleted_document_freqs_.size() <= static_cast<size_t>(term_id)) {
+            deleted_document_freqs_.resize(term_id + 1, 0);
+        }
+        ++deleted_document_freqs_[term_id];
+    }
+
+    // Списки не меняются: при ближайшем обращении пересчитывается только кэш IDF
+    --document_count_;
+    ++epoch_;
+    has_pending_.store(true, memory_order_release);
+
+    ScheduleCompaction();
+}
+
+void InvertedIndex::RemoveDocuments(const vector<int>& ordinals, const vector<int>& term_ids) {
+    if (ordinals.empty()) {
+        return;
+    }
+    InstallCompaction(false);
+
+    pending_removals_.insert(ordinals.begin(), ordinals.end());
+    pending_removal_terms_.insert(pending_removal_terms_.end(), term_ids.begin(), term_ids.end());
+
+    document_count_ -= static_cast<int>(ordinals.size());
+    ++epoch_;
+    has_pending_.store(true, memory_order_release);
+}
+
+void InvertedIndex::SetFormat(PostingFormat format) {
+    InstallCompaction(false);
+    requested_format_ = format;
+    has_pending_.store(true, memory_order_release);
+}
+
+PostingFormat InvertedIndex::GetFormat() const {
+    return requested_format_;
+}
+
+void InvertedIndex::SetScoreBlockSize(size_t block_size) {
+    InstallCompaction(false);
+    requested_score_block_size_ = max<size_t>(block_size, 1);
+    has_pending_.store(true, memory_order_release);
+}
+
+size_t InvertedIndex::GetScoreBlockSize() const {
+    return requested_score_block_size_;
+}
+
+void InvertedIndex::SetCompactionRatio(double ratio) {
+    compaction_ratio_ = ratio;
+    ScheduleCompaction();
+}
+
+double InvertedIndex::GetCompactionRatio() const {
+    return compaction_ratio_;
+}
+
+void InvertedIndex::WaitForCompaction() {
+    InstallCompaction(true);
+    // Документы, помеченные во время уплотнения, уплотняются следующим
+    ScheduleCompaction();
+    InstallCompaction(true);
+}
+
+size_t InvertedIndex::GetDocumentFreq(int term_id) const {
+    const size_t posting_count = GetPostingCount(term_id);
+    if (posting_count == 0 || static_cast<size_t>(term_id) >= deleted_document_freqs_.size()) {
+        return posting_count;
+    }
+    return posting_count - deleted_document_freqs_[term_id];
+}
+
+size_t InvertedIndex::GetPostingCount(int term_id) const {
+    if (has_pending_.load(memory_order_acquire)) {
+        Merge();
+    }
+
+    // Слово могло появиться в словаре, но не попасть ни в один документ индекса
+    if (term_id < 0 || static_cast<size_t>(term_id) + 1 >= posting_offsets_.size()) {
+        return 0;
+    }
+    return posting_offsets_[term_id + 1] - posting_offsets_[term_id];
+}
+
+int InvertedIndex::GetDocumentCount() const {
+    return document_count_;
+}
+
+int InvertedIndex::GetWordCount(int ordinal) const {
+    return static_cast<int>(word_counts_[ordinal]);
+}
+
+double InvertedIndex::GetInverseDocumentFreq(int term_id) const {
+    if (has_pending_.load(memory_order_acquire)) {
+        Merge();
+    }
+
+    if (term_id < 0 || static_cast<size_t>(term_id) >= inverse_document_freqs_.size()) {
+        return 0.0;
+    }
+    return inverse_document_freqs_[term_id];
+}
+
+double InvertedIndex::GetMaxTermFreq(int term_id) const {
+    if (has_pending_.load(memory_order_acquire)) {
+        Merge();
+    }
+
+    if (term_id < 0 || static_cast<size_t>(term_id) >= max_term_freqs_.size()) {
+        return 0.0;
+    }
+    return max_term_freqs_[term_id];
+}
+
+InvertedIndex::PostingList InvertedIndex::GetPostings(int term_id, PostingBuffer& buffer) const {
+    const size_t size = GetPostingCount(term_id);
+    if (size == 0) {
+        return {};
+    }
+
+    const size_t first_block = score_block_offsets_[term_id];
+    const size_t block_count = score_block_offsets_[term_id + 1] - first_block;
+
+    if (format_ == PostingFormat::RAW) {
+        const size_t begin = posting_offsets_[term_id];
+        return { posting_ordinals_.data() + begin, posting_term_freqs_.data() + begin, size,
+            score_block_last_ordinals_.data() + first_block, score_block_max_term_freqs_.data() + first_block, block_count };
+    }
+
+    // Распаковываем все блоки слова подряд
+    buffer.ordinals.resize(size);
+    buffer.term_freqs.resize(size);
+    buffer.values.resize(size);
+
+    size_t position = 0;
+    for (size_t block = term_block_offsets_[term_id]; block < term_block_offsets_[term_id + 1]; ++block) {
+        const size_t block_size = DecodeBlock(term_id, block, buffer.ordinals.data() + position, buffer.values.data() + position);
+        for (size_t i = position; i < position + block_size; ++i) {
+            buffer.term_freqs[i] = GetTermFreq(buffer.ordinals[i], buffer.values[i]);
+        }
+        position += block_size;
+    }
+
+    return { buffer.ordinals.data(), buffer.term_freqs.data(), size,
+        score_block_last_ordinals_.data() + first_block, score_block_max_term_freqs_.data() + first_block, block_count };
+}
+
+bool InvertedIndex::ContainsDocument(int term_id, int ordinal) const {
+    const size_t size = GetPostingCount(term_id);
+    if (size == 0) {
+        return false;
+    }
+
+    if (format_ == PostingFormat::RAW) {
+        const int* begin = posting_ordinals_.data() + posting_offsets_[term_id];
+        return binary_search(begin, begin + size, ordinal);
+    }
+
+    // Находим единственный блок, который может содержать документ
+    const auto blocks_begin = block_last_ordinals_.begin() + term_block_offsets_[term_id];
+    const auto blocks_end = block_last_ordinals_.begin() + term_block_offsets_[term_id + 1];
+    const auto block_it = lower_bound(blocks_begin, blocks_end, static_cast<uint32_t>(ordinal));
+    if (block_it == blocks_end) {
+        return false;
+    }
+
+    int ordinals[POSTING_BLOCK_SIZE];
+    uint32_t counts[POSTING_BLOCK_SIZE];
+    const size_t block_size = DecodeBlock(term_id, block_it - block_last_ordinals_.begin(), ordinals, counts);
+    return binary_search(ordinals, ordinals + block_size, ordinal);
+}
+
+size_t InvertedIndex::GetPostingsByteSize() const {
+    Merge();
+
+    size_t byte_size = posting_offsets_.size() * sizeof(size_t)
+        + score_block_offsets_.size() * sizeof(size_t)
+        + score_block_last_ordinals_.size() * sizeof(int)
+        + score_block_max_term_freqs_.size() * sizeof(double);
+    if (format_ == PostingFormat::RAW) {
+        byte_size += posting_ordinals_.size() * sizeof(int) + posting_term_freqs_.size() * sizeof(double);
+    }
+    else {
+        byte_size += term_block_offsets_.size() * sizeof(size_t)
+            + block_last_ordinals_.size() * sizeof(uint32_t)
+            + block_byte_offsets_.size() * sizeof(size_t)
+            + compressed_postings_.size();
+    }
+    return byte_size;
+}
+
+void InvertedIndex::Merge() const {
+    MergeLocked(false, nullptr);
+}
+
+void InvertedIndex::Merge(const execution::parallel_policy& policy, ThreadPool* thread_pool) const {
+    MergeLocked(true, thread_pool);
+}
+
+void InvertedIndex::MergeLocked(bool parallel, ThreadPool* thread_pool) const {
+    lock_guard guard(merge_mutex_);
+    if (has_pending_.load(memory_order_relaxed)) {
+        if (HasPendingPostings()) {
+            // Уплотнение читает массивы, которые заменит слияние: дожидаемся
+            // его и сливаем буфер уже с уплотненными списками
+            InstallCompaction(true);
+            MergeUnlocked(parallel, thread_pool);
+        }
+        if (inverse_document_freqs_epoch_ != epoch_
+            || inverse_document_freqs_.size() + 1 != posting_offsets_.size()) {
+            UpdateInverseDocumentFreqs();
+        }
+        has_pending_.store(false, memory_order_release);
+    }
+}
+
+void InvertedIndex::UpdateInverseDocumentFreqs() const {
+    const size_t term_count = posting_offsets_.size() - 1;
+    inverse_document_freqs_.resize(term_count);
+
+    for (size_t term_id = 0; term_id < term_count; ++term_id) {
+        size_t document_freq = posting_offsets_[term_id + 1] - posting_offsets_[term_id];
+        if (term_id < deleted_document_freqs_.size()) {
+            document_freq -= deleted_document_freqs_[term_id];
+        }
+        inverse_document_freqs_[term_id] = document_freq == 0 ? 0.0 : log(document_count_ * 1.0 / document_freq);
+    }
+
+    inverse_document_freqs_epoch_ = epoch_;
+}
+
+// Слитые списки диапазона слов в формате основных массивов. Смещения
+// отсчитываются от начала диапазона
+struct InvertedIndex::MergedTerms {
+    vector<size_t> posting_offsets = { 0 };
+    vector<double> max_term_freqs;
+    vector<size_t> score_block_offsets = { 0 };
+    vector<int> score_block_last_ordinals;
+    vector<double> score_block_max_term_freqs;
+    vector<int> ordinals;
+    vector<double> term_freqs;
+    vector<size_t> term_block_offsets = { 0 };
+    vector<uint32_t> block_last_ordinals;
+    vector<size_t> block_byte_offsets;
+    vector<uint8_t> compressed_postings;
+};
+
+struct InvertedIndex::MergeContext {
+    PostingFormat format;
+    size_t score_block_size;
+    size_t old_term_count;
+
+    // Списки слов без новых записей и удалений можно копировать без
+    // перекодирования: формат и блоки оценок не меняются
+    bool can_copy;
+
+    // Признаки удаленных документов по ordinal (пусто, если удалений нет)
+    // и слов, списки которых затронуты удалениями
+    vector<char> removed;
+    vector<char> dirty_terms;
+
+    // Новые записи, упорядоченные по (term id, ordinal), и длины документов.
+    // Уплотнение работает с копией длин: AddDocument может менять word_counts_
+    const TermPosting* pending_begin = nullptr;
+    const TermPosting* pending_end = nullptr;
+    const vector<uint32_t>* word_counts = nullptr;
+};
+
+void InvertedIndex::MergeUnlocked(bool parallel, ThreadPool* thread_pool) const {
+    // Сортируем буфер по слову, внутри слова - по документу. Буфер пакетного
+    // добавления обычно уже отсортирован
+    auto is_less = [](const TermPosting& lhs, const TermPosting& rhs) {
+        return lhs.term_id != rhs.term_id ? lhs.term_id < rhs.term_id : lhs.ordinal < rhs.ordinal;
+    };
+    if (!is_sorted(pending_postings_.begin(), pending_postings_.end(), is_less)) {
+        sort(pending_postings_.begin(), pending_postings_.end(), is_less);
+    }
+
+    MergeContext context;
+    context.format = requested_format_;
+    context.score_block_size = requested_score_block_size_;
+    context.old_term_count = posting_offsets_.size() - 1;
+    context.can_copy = format_ == context.format && score_block_size_ == context.score_block_size;
+    context.pending_begin = pending_postings_.data();
+    context.pending_end = pending_postings_.data() + pending_postings_.size();
+    context.word_counts = &word_counts_;
+
+    size_t term_count = context.old_term_count;
+    if (!pending_postings_.empty()) {
+        term_count = max(term_count, static_cast<size_t>(pending_postings_.back().term_id) + 1);
+    }
+
+    // Хеш-таблица удалений заменяется массивом признаков: проверка записи
+    // списка не должна стоить хеширования
+    if (!pending_removals_.empty()) {
+        context.removed.assign(word_counts_.size(), 0);
+        for (const int ordinal : pending_removals_) {
+            context.removed[ordinal] = 1;
+        }
+    }
+    context.dirty_terms.assign(term_count, 0);
+    for (const int term_id : pending_removal_terms_) {
+        context.dirty_terms[term_id] = 1;
+    }
+
+    // Диапазоны слов сливаются независимо: для параллельного слияния их
+    // больше, чем потоков, чтобы длинные списки частых слов не задерживали остальные
+    size_t range_count = 1;
+    if (parallel) {
+        const size_t thread_count = thread_pool != nullptr
+            ? thread_pool->GetThreadCount()
+            : max(1u, thread::hardware_concurrency());
+        range_count = max<size_t>(1, min(term_count, thread_count * 16));
+    }
+    vector<MergedTerms> ranges(range_count);
+    auto merge_range = [&](size_t i) {
+        MergeTerms(context, term_count * i / range_count, term_count * (i + 1) / range_count, ranges[i]);
+    };
+    if (parallel) {
+        ForEachIndex(execution::par, thread_pool, range_count, merge_range);
+    }
+    else {
+        merge_range(0);
+    }
+
+    // Склеиваем диапазоны в первый, сдвигая смещения на размеры предыдущих
+    // диапазонов. При однопоточном слиянии диапазон один и ничего не копируется
+    MergedTerms& result = ranges.front();
+    for (size_t i = 1; i < ranges.size(); ++i) {
+        AppendMergedTerms(ranges[i], result);
+    }
+    format_ = context.format;
+    score_block_size_ = context.score_block_size;
+    InstallMergedTerms(result);
+
+    pending_postings_.clear();
+    pending_postings_.shrink_to_fit();
+    pending_removals_.clear();
+    pending_removal_terms_.clear();
+    pending_removal_terms_.shrink_to_fit();
+
+    // Уплотнение, отложенное из-за непустого буфера
+    ScheduleCompaction();
+}
+
+void InvertedIndex::InstallMergedTerms(MergedTerms& merged_terms) const {
+    // Запас байт для SIMD-декодера, читающего по 16 байт
+    if (format_ == PostingFormat::COMPRESSED) {
+        merged_terms.compressed_postings.resize(merged_terms.compressed_postings.size() + STREAM_VBYTE_PADDING, 0);
+        merged_terms.compressed_postings.shrink_to_fit();
+    }
+
+    posting_offsets_ = move(merged_terms.posting_offsets);
+    max_term_freqs_ = move(merged_terms.max_term_freqs);
+    score_block_offsets_ = move(merged_terms.score_block_offsets);
+    score_block_last_ordinals_ = move(merged_terms.score_block_last_ordinals);
+    score_block_max_term_freqs_ = move(merged_terms.score_block_max_term_freqs);
+    posting_ordinals_ = move(merged_terms.ordinals);
+    posting_term_freqs_ = move(merged_terms.term_freqs);
+    term_block_offsets_ = move(merged_terms.term_block_offsets);
+    block_last_ordinals_ = move(merged_terms.block_last_ordinals);
+    block_byte_offsets_ = move(merged_terms.block_byte_offsets);
+    compressed_postings_ = move(merged_terms.compressed_postings);
+}
+
+bool InvertedIndex::HasPendingPostings() const {
+    return !pending_postings_.empty() || !pending_removals_.empty()
+        || requested_format_ != format_ || requested_score_block_size_ != score_block_size_;
+}
+
+void InvertedIndex::ScheduleCompaction() const {
+    if (compaction_.valid() || tombstones_.empty() || compaction_ratio_ >= 1.0
+        || tombstones_.size() < compaction_ratio_ * (document_count_ + tombstones_.size())) {
+        return;
+    }
+    // Помеченный документ из буфера записи еще не попал в списки, и уплотнение
+    // его бы не нашло. Буфер вливается при ближайшем обращении к спискам
+    if (HasPendingPostings()) {
+        return;
+    }
+
+    compacting_tombstones_ = move(tombstones_);
+    compacting_terms_ = move(tombstone_terms_);
+    tombstones_.clear();
+    tombstone_terms_.clear();
+
+    // Уплотнение переписывает только списки слов помеченных документов в их
+    // текущем формате, остальные копируются
+    MergeContext context;
+    context.format = format_;
+    context.score_block_size = score_block_size_;
+    context.old_term_count = posting_offsets_.size() - 1;
+    context.can_copy = true;
+    context.removed.assign(word_counts_.size(), 0);
+    for (const int ordinal : compacting_tombstones_) {
+        context.removed[ordinal] = 1;
+    }
+    context.dirty_terms.assign(context.old_term_count, 0);
+    for (const int term_id : compacting_terms_) {
+        if (static_cast<size_t>(term_id) < context.old_term_count) {
+            context.dirty_terms[term_id] = 1;
+        }
+    }
+
+    // Массивы списков не меняются, пока уплотнение не закончится: слияние
+    // буфера и копирование индекса его дожидаются
+    compaction_ = async(launch::async, [this, context = move(context), word_counts = word_counts_]() mutable {
+        context.word_counts = &word_counts;
+        auto merged_terms = make_shared<MergedTerms>();
+        MergeTerms(context, 0, context.old_term_count, *merged_terms);
+        return merged_terms;
+    });
+}
+
+void InvertedIndex::InstallCompaction(bool wait) const {
+    if (!compaction_.valid()
+        || (!wait && compaction_.wait_for(chrono::seconds(0)) != future_status::ready)) {
+        return;
+    }
+    const shared_ptr<MergedTerms> merged_terms = compaction_.get();
+
+    // Из списков убраны ровно документы уплотнения, поэтому разница длин
+    // старого и нового списка - количество убранных из него помеченных документов
+    const size_t term_count = min(posting_offsets_.size() - 1, deleted_document_freqs_.size());
+    for (size_t term_id = 0; term_id < term_count; ++term_id) {
+        deleted_document_freqs_[term_id] -= static_cast<uint32_t>(
+            (posting_offsets_[term_id + 1] - posting_offsets_[term_id])
+            - (merged_terms->posting_offsets[term_id + 1] - merged_terms->posting_offsets[term_id]));
+    }
+    InstallMergedTerms(*merged_terms);
+
+    for (const int ordinal : compacting_tombstones_) {
+        deleted_documents_.Remove(ordinal);
+    }
+    has_deleted_documents_ = !tombstones_.empty();
+    compacting_tombstones_.clear();
+    compacting_terms_.clear();
+}
+
+void InvertedIndex::AppendMergedTerms(const MergedTerms& source, MergedTerms& target) {
+    auto append = [](auto& target_values, const auto& source_values) {
+        target_values.insert(target_values.end(), source_values.begin(), source_values.end());
+    };
+    auto append_shifted = [](vector<size_t>& target_offsets, const vector<size_t>& source_offsets, size_t shift) {
+        for (auto it = next(source_offsets.begin()); it != source_offsets.end(); ++it) {
+            target_offsets.push_back(*it + shift);
+        }
+    };
+
+    append_shifted(target.posting_offsets, source.posting_offsets, target.posting_offsets.back());
+    append(target.max_term_freqs, source.max_term_freqs);
+    append_shifted(target.score_block_offsets, source.score_block_offsets, target.score_block_last_ordinals.size());
+    append(target.score_block_last_ordinals, source.score_block_last_ordinals);
+    append(target.score_block_max_term_freqs, source.score_block_max_term_freqs);
+    append(target.ordinals, source.ordinals);
+    append(target.term_freqs, source.term_freqs);
+    append_shifted(target.term_block_offsets, source.term_block_offsets, target.block_last_ordinals.size());
+    append(target.block_last_ordinals, source.block_last_ordinals);
+    for (const size_t byte_offset : source.block_byte_offsets) {
+        target.block_byte_offsets.push_back(byte_offset + target.compressed_postings.size());
+    }
+    append(target.compressed_postings, source.compressed_postings);
+}
+
+void InvertedIndex::MergeTerms(const MergeContext& context, size_t term_begin, size_t term_end, MergedTerms& merged_terms) const {
+    const PostingFormat format = context.format;
+    const size_t score_block_size = context.score_block_size;
+    const size_t old_term_count = context.old_term_count;
+
+    auto is_removed = [&context](int ordinal) {
+        return !context.removed.empty() && context.removed[ordinal] != 0;
+    };
+    const vector<uint32_t>& word_counts = *context.word_counts;
+    auto get_term_freq = [&word_counts](int ordinal, uint32_t count) {
+        return count * (1.0 / word_counts[ordinal]);
+    };
+
+    // Новые записи слов диапазона
+    auto is_before_term = [](const TermPosting& posting, size_t term_id) {
+        return static_cast<size_t>(posting.term_id) < term_id;
+    };
+    auto pending_it = lower_bound(context.pending_begin, context.pending_end, term_begin, is_before_term);
+    const auto pending_end = lower_bound(pending_it, context.pending_end, term_end, is_before_term);
+
+    // Оценка размера диапазона: старые записи его слов и новые из буфера
+    const size_t range_term_count = term_end - term_begin;
+    const size_t posting_estimate = posting_offsets_[min(term_end, old_term_count)]
+        - posting_offsets_[min(term_begin, old_term_count)]
+        + static_cast<size_t>(pending_end - pending_it);
+    merged_terms.posting_offsets.reserve(range_term_count + 1);
+    merged_terms.max_term_freqs.reserve(range_term_count);
+    merged_terms.score_block_offsets.reserve(range_term_count + 1);
+    merged_terms.score_block_last_ordinals.reserve(range_term_count + posting_estimate / score_block_size);
+    merged_terms.score_block_max_term_freqs.reserve(range_term_count + posting_estimate / score_block_size);
+    if (format == PostingFormat::RAW) {
+        merged_terms.ordinals.reserve(posting_estimate);
+        merged_terms.term_freqs.reserve(posting_estimate);
+    }
+    else {
+        merged_terms.term_block_offsets.reserve(range_term_count + 1);
+        merged_terms.compressed_postings.reserve(posting_estimate * 2);
+    }
+
+    // Старый список слова, слитый список и буферы кодирования
+    vector<int> old_ordinals(POSTING_BLOCK_SIZE);
+    vector<uint32_t> old_counts(POSTING_BLOCK_SIZE);
+    vector<pair<int, uint32_t>> old_postings;
+    vector<pair<int, uint32_t>> merged;
+    vector<uint32_t> block_values;
+
+    for (size_t term_id = term_begin; term_id < term_end; ++term_id) {
+        const bool has_pending = pending_it != pending_end && static_cast<size_t>(pending_it->term_id) == term_id;
+
+        // Список, не затронутый буфером, копируется как есть
+        if (context.can_copy && term_id < old_term_count && !has_pending && context.dirty_terms[term_id] == 0) {
+            merged_terms.posting_offsets.push_back(merged_terms.posting_offsets.back()
+                + posting_offsets_[term_id + 1] - posting_offsets_[term_id]);
+            merged_terms.max_term_freqs.push_back(max_term_freqs_[term_id]);
+
+            const auto score_begin = static_cast<ptrdiff_t>(score_block_offsets_[term_id]);
+            const auto score_end = static_cast<ptrdiff_t>(score_block_offsets_[term_id + 1]);
+            merged_terms.score_block_last_ordinals.insert(merged_terms.score_block_last_ordinals.end(),
+                score_block_last_ordinals_.begin() + score_begin, score_block_last_ordinals_.begin() + score_end);
+            merged_terms.score_block_max_term_freqs.insert(merged_terms.score_block_max_term_freqs.end(),
+                score_block_max_term_freqs_.begin() + score_begin, score_block_max_term_freqs_.begin() + score_end);
+            merged_terms.score_block_offsets.push_back(merged_terms.score_block_last_ordinals.size());
+
+            if (format == PostingFormat::RAW) {
+                const auto begin = static_cast<ptrdiff_t>(posting_offsets_[term_id]);
+                const auto end = static_cast<ptrdiff_t>(posting_offsets_[term_id + 1]);
+                merged_terms.ordinals.insert(merged_terms.ordinals.end(),
+                    posting_ordinals_.begin() + begin, posting_ordinals_.begin() + end);
+                merged_terms.term_freqs.insert(merged_terms.term_freqs.end(),
+                    posting_term_freqs_.begin() + begin, posting_term_freqs_.begin() + end);
+                continue;
+            }
+
+            // Блоки слова кодируются относительно начала его списка, поэтому
+            // байты переносятся без перекодирования
+            const size_t first_block = term_block_offsets_[term_id];
+            const size_t last_block = term_block_offsets_[term_id + 1];
+            if (first_block < last_block) {
+                const size_t byte_begin = block_byte_offsets_[first_block];
+                const size_t byte_end = last_block < block_byte_offsets_.size()
+                    ? block_byte_offsets_[last_block]
+                    : compressed_postings_.size() - STREAM_VBYTE_PADDING;
+                for (size_t block = first_block; block < last_block; ++block) {
+                    merged_terms.block_last_ordinals.push_back(block_last_ordinals_[block]);
+                    merged_terms.block_byte_offsets.push_back(
+                        block_byte_offsets_[block] - byte_begin + merged_terms.compressed_postings.size());
+                }
+                merged_terms.compressed_postings.insert(merged_terms.compressed_postings.end(),
+                    compressed_postings_.begin() + static_cast<ptrdiff_t>(byte_begin),
+                    compressed_postings_.begin() + static_cast<ptrdiff_t>(byte_end));
+            }
+            merged_terms.term_block_offsets.push_back(merged_terms.block_last_ordinals.size());
+            continue;
+        }
+
+        // Читаем старый список слова в текущем формате
+        old_postings.clear();
+        if (term_id < old_term_count) {
+            if (format_ == PostingFormat::RAW) {
+                for (size_t i = posting_offsets_[term_id]; i < posting_offsets_[term_id + 1]; ++i) {
+                    const int ordinal = posting_ordinals_[i];
+                    const auto count = static_cast<uint32_t>(lround(posting_term_freqs_[i] * word_counts[ordinal]));
+                    old_postings.emplace_back(ordinal, count);
+                }
+            }
+            else {
+                for (size_t block = term_block_offsets_[term_id]; block < term_block_offsets_[term_id + 1]; ++block) {
+                    const size_t block_size = DecodeBlock(term_id, block, old_ordinals.data(), old_counts.data());
+                    for (size_t i = 0; i < block_size; ++i) {
+                        old_postings.emplace_back(old_ordinals[i], old_counts[i]);
+                    }
+                }
+            }
+        }
+
+        // Сливаем два отсортированных списка: старый и новый из буфера
+        merged.clear();
+        auto old_it = old_postings.begin();
+        while (pending_it != pending_end && static_cast<size_t>(pending_it->term_id) == term_id) {
+            for (; old_it != old_postings.end() && old_it->first < pending_it->ordinal; ++old_it) {
+                if (!is_removed(old_it->first)) {
+                    merged.push_back(*old_it);
+                }
+            }
+            if (!is_removed(pending_it->ordinal)) {
+                merged.emplace_back(pending_it->ordinal, pending_it->count);
+            }
+            ++pending_it;
+        }
+        for (; old_it != old_postings.end(); ++old_it) {
+            if (!is_removed(old_it->first)) {
+                merged.push_back(*old_it);
+            }
+        }
+
+        merged_terms.posting_offsets.push_back(merged_terms.posting_offsets.back() + merged.size());
+
+        double max_term_freq = 0.0;
+        for (size_t begin = 0; begin < merged.size(); begin += score_block_size) {
+            const size_t end = min(begin + score_block_size, merged.size());
+            double block_max_term_freq = 0.0;
+            for (size_t i = begin; i < end; ++i) {
+                block_max_term_freq = max(block_max_term_freq, get_term_freq(merged[i].first, merged[i].second));
+            }
+            merged_terms.score_block_last_ordinals.push_back(merged[end - 1].first);
+            merged_terms.score_block_max_term_freqs.push_back(block_max_term_freq);
+            max_term_freq = max(max_term_freq, block_max_term_freq);
+        }
+        merged_terms.max_term_freqs.push_back(max_term_freq);
+        merged_terms.score_block_offsets.push_back(merged_terms.score_block_last_ordinals.size());
+
+        // Записываем слитый список в новом формате
+        if (format == PostingFormat::RAW) {
+            for (const auto& [ordinal, count] : merged) {
+                merged_terms.ordinals.push_back(ordinal);
+                merged_terms.term_freqs.push_back(get_term_freq(ordinal, count));
+            }
+            continue;
+        }
+
+        uint32_t previous_last = 0;
+        for (size_t begin = 0; begin < merged.size(); begin += POSTING_BLOCK_SIZE) {
+            const size_t end = min(begin + POSTING_BLOCK_SIZE, merged.size());
+
+            merged_terms.block_last_ordinals.push_back(merged[end - 1].first);
+            merged_terms.block_byte_offsets.push_back(merged_terms.compressed_postings.size());
+
+            // Разности номеров документов относительно последнего номера предыдущего блока
+            block_values.clear();
+            for (size_t i = begin; i < end; ++i) {
+                block_values.push_back(merged[i].first);
+            }
+            EncodeDeltas(block_values.data(), block_values.size(), previous_last);
+            EncodeStreamVByte(block_values.data(), block_values.size(), merged_terms.compressed_postings);
+
+            // Количества вхождений слова
+            block_values.clear();
+            for (size_t i = begin; i < end; ++i) {
+                block_values.push_back(merged[i].second);
+            }
+            EncodeStreamVByte(block_values.data(), block_values.size(), merged_terms.compressed_postings);
+
+            previous_last = merged[end - 1].first;
+        }
+        merged_terms.term_block_offsets.push_back(merged_terms.block_last_ordinals.size());
+    }
+}
+
+size_t InvertedIndex::DecodeBlock(int term_id, size_t block, int* ordinals, uint32_t* counts) const {
+    // Все блоки слова, кроме последнего, заполнены полностью
+    const size_t first_block = term_block_offsets_[term_id];
+    const size_t term_size = posting_offsets_[term_id + 1] - posting_offsets_[term_id];
+    const size_t block_size = min(POSTING_BLOCK_SIZE, term_size - (block - first_block) * POSTING_BLOCK_SIZE);
+
+    // Первый номер блока закодирован относительно последнего номера предыдущего блока
+    const uint32_t base = block == first_block ? 0 : block_last_ordinals_[block - 1];
+
+    // int и uint32_t имеют одинаковое представление, поэтому номера распаковываются на месте
+    uint32_t* values = reinterpret_cast<uint32_t*>(ordinals);
+    const uint8_t* data = compressed_postings_.data() + block_byte_offsets_[block];
+    data = DecodeStreamVByte(data, block_size, values);
+    DecodeDeltas(values, block_size, base);
+    DecodeStreamVByte(data, block_size, counts);
+
+    return block_size;
+}
+
+double InvertedIndex::GetTermFreq(int ordinal, uint32_t count) const {
+    return count * (1.0 / word_counts_[ordinal]);
+}
@@ -0,0 +1,302 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <execution>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "document_bitmap.h"
+
+// Формат хранения списков документов в индексе
+enum class PostingFormat {
+    // Несжатые параллельные массивы: номера документов и частоты слова
+    RAW,
+    // Блоки по POSTING_BLOCK_SIZE записей: разности номеров документов и
+    // количества вхождений слова, сжатые StreamVByte
+    COMPRESSED,
+};
+
+class ThreadPool;
+
+// Количество записей в блоке сжатого списка документов
+const size_t POSTING_BLOCK_SIZE = 128;
+
+// Количество записей в блоке, для которого хранится наибольшая частота слова
+const size_t DEFAULT_SCORE_BLOCK_SIZE = 64;
+
+// Доля удаленных документов среди документов списков, после которой
+// запускается фоновое уплотнение
+const double DEFAULT_COMPACTION_RATIO = 0.2;
+
+// Инвертированный индекс в формате CSR: списки документов всех слов лежат
+// подряд в двух параллельных массивах (внутренние номера документов и частоты
+// слова), а posting_offsets_[term_id] указывает начало списка слова term_id.
+// Внутренние номера документов внутри списка отсортированы по возрастанию.
+//
+// В формате COMPRESSED вместо параллельных массивов хранится поток байт,
+// разбитый на блоки. Частота слова не хранится: вместо нее записывается
+// количество вхождений слова, а частота восстанавливается делением на длину
+// документа, поэтому сжатие не теряет точности.
+//
+// Добавление и удаление документов не трогают CSR-массивы, а копятся в буфере
+// записи. Буфер вливается в основные массивы одним проходом при первом
+// обращении к спискам (Merge), поэтому пакетная загрузка документов стоит O(P).
+// Слияние переписывает только списки слов, затронутых буфером; остальные
+// списки копируются как есть. Диапазоны слов независимы и сливаются
+// параллельно в Merge(par, ...).
+//
+// Списки документов независимо от формата разбиты на блоки оценок по
+// GetScoreBlockSize() записей. Для каждого блока хранятся последний номер
+// документа и наибольшая частота слова в блоке: это позволяет при поиске
+// пропускать блоки целиком, не трогая их записи.
+//
+// RemoveDocument не трогает списки: документ помечается удаленным (tombstone)
+// в битовой карте, которую учитывает поиск, а количества документов слов
+// уменьшаются сразу, поэтому IDF и GetDocumentCount верны без слияния. Когда
+// доля помеченных документов превышает GetCompactionRatio(), фоновый поток
+// строит копии затронутых списков без них (уплотнение). Готовые списки
+// подменяются при ближайшем изменении индекса или слиянии буфера, когда
+// читатели не держат указателей на старые.
+//
+// Вместе со списками индекс хранит кэш IDF каждого слова. Любое изменение
+// количества документов сдвигает эпоху индекса, и кэш пересчитывается целиком
+// при ближайшем слиянии - один раз после пакетной загрузки, а не на каждый запрос
+class InvertedIndex {
+public:
+    // Список документов одного слова: указатели на начало параллельных массивов
+    // и на последние номера документов и наибольшие частоты его блоков оценок
+    struct PostingList {
+        const int* ordinals = nullptr;
+        const double* term_freqs = nullptr;
+        size_t size = 0;
+
+        const int* block_last_ordinals = nullptr;
+        const double* block_max_term_freqs = nullptr;
+        size_t block_count = 0;
+
+        bool empty() const {
+            return size == 0;
+        }
+    };
+
+    // Буфер для распаковки сжатого списка документов
+    struct PostingBuffer {
+        std::vector<int> ordinals;
+        std::vector<double> term_freqs;
+        std::vector<uint32_t> values;
+    };
+
+    InvertedIndex() = default;
+    InvertedIndex(const InvertedIndex& other);
+    InvertedIndex& operator=(const InvertedIndex& other);
+
+    // Дожидается фонового уплотнения
+    ~InvertedIndex();
+
+    // Добавление документа в буфер записи: количество слов в документе и
+    // пары (term id, количество вхождений слова в документ)
+    void AddDocument(int ordinal, int word_count, const std::vector<std::pair<int, int>>& term_counts);
+
+    // Пометка документа как удаленного (tombstone): term_ids - слова документа,
+    // их количества документов уменьшаются сразу. Списки не переписываются:
+    // документ исчезнет из них при фоновом уплотнении
+    void RemoveDocument(int ordinal, const std::vector<int>& term_ids);
+
+    // Помечен ли документ как удаленный и еще не убран из списков уплотнением
+    bool IsDeleted(int ordinal) const {
+        return has_deleted_documents_ && deleted_documents_.Contains(ordinal);
+    }
+
+    // Пометка документов как удаленных: term_ids - слова всех документов
+    // (повторы допустимы). Каждый затронутый список переписывается при слиянии
+    // один раз, сколько бы документов из него ни удалялось
+    void RemoveDocuments(const std::vector<int>& ordinals, const std::vector<int>& term_ids);
+
+    // Смена формата хранения. Индекс перекодируется при следующем слиянии
+    void SetFormat(PostingFormat format);
+    PostingFormat GetFormat() const;
+
+    // Смена размера блока оценок. Блоки перестраиваются при следующем слиянии
+    void SetScoreBlockSize(size_t block_size);
+    size_t GetScoreBlockSize() const;
+
+    // Доля помеченных удаленными документов, после которой запускается
+    // уплотнение. Значение не меньше 1 отключает уплотнение
+    void SetCompactionRatio(double ratio);
+    double GetCompactionRatio() const;
+
+    // Ожидание фонового уплотнения и подмена списков уплотненными, затем
+    // уплотнение оставшихся помеченных документов, если их доля выше порога.
+    // Вызывается, как и AddDocument, без параллельных читателей
+    void WaitForCompaction();
+
+    // Количество документов со словом без помеченных удаленными
+    size_t GetDocumentFreq(int term_id) const;
+
+    // Количество документов в индексе
+    int GetDocumentCount() const;
+
+    // Количество слов документа, переданное в AddDocument
+    int GetWordCount(int ordinal) const;
+
+    // Закэшированная обратная частота слова log(N / df). Для слова без документов - 0.
+    // Помеченные удаленными документы не учитываются ни в N, ни в df
+    double GetInverseDocumentFreq(int term_id) const;
+
+    // Наибольшая частота слова среди документов его списка. Для слова без документов - 0.
+    // Вместе с IDF дает верхнюю оценку вклада слова в релевантность любого документа
+    double GetMaxTermFreq(int term_id) const;
+
+    // Список документов слова. Перед выдачей вливает буфер записи в CSR.
+    // Для сжатого формата список распаковывается в buffer. Список может
+    // содержать помеченные удаленными документы (см. IsDeleted)
+    PostingList GetPostings(int term_id, PostingBuffer& buffer) const;
+
+    // Проверка, что документ есть в списке слова. Распаковывает не более одного блока
+    bool ContainsDocument(int term_id, int ordinal) const;
+
+    // Объем памяти, занимаемый списками документов, в байтах
+    size_t GetPostingsByteSize() const;
+
+    // Вливание буфера записи в CSR-массивы. Потокобезопасно относительно
+    // других читателей, но не относительно AddDocument/RemoveDocument
+    void Merge() const;
+
+    // Вливание буфера записи с параллельным слиянием диапазонов слов в пуле
+    // thread_pool (без пула - в std::execution::par)
+    void Merge(const std::execution::parallel_policy& policy, ThreadPool* thread_pool = nullptr) const;
+
+    // Вхождение слова в документ: слово, документ и количество вхождений
+    struct TermPosting {
+        int term_id;
+        int ordinal;
+        uint32_t count;
+    };
+
+    // Пакетное добавление документов first_ordinal, first_ordinal + 1, ...:
+    // word_counts - количества слов документов, postings - их вхождения.
+    // Вхождения, уже упорядоченные по (term id, ordinal), вливаются без сортировки
+    void AddDocuments(int first_ordinal, const std::vector<int>& word_counts, std::vector<TermPosting> postings);
+
+private:
+    // Слитые списки диапазона слов
+    struct MergedTerms;
+
+    // Общие для всех диапазонов параметры слияния
+    struct MergeContext;
+
+    // Формат, в котором хранятся списки, и формат, запрошенный для следующего слияния
+    mutable PostingFormat format_ = PostingFormat::RAW;
+    PostingFormat requested_format_ = PostingFormat::RAW;
+
+    // Длины документов (количество слов без стоп-слов) по ordinal
+    std::vector<uint32_t> word_counts_;
+
+    // Количество документов и эпоха индекса, увеличивающаяся при каждом
+    // добавлении и удалении документа
+    int document_count_ = 0;
+    uint64_t epoch_ = 0;
+
+    // Кэш IDF по term id и эпоха, для которой он посчитан
+    mutable std::vector<double> inverse_document_freqs_;
+    mutable uint64_t inverse_document_freqs_epoch_ = 0;
+
+    // Наибольшая частота каждого слова, пересчитывается при слиянии
+    mutable std::vector<double> max_term_freqs_;
+
+    // Блоки оценок: размер блока для следующего слияния и размер блока в текущих
+    // списках, начало блоков каждого слова
+    // (размер - количество слов + 1), последний номер документа и наибольшая частота слова в блоке
+    size_t requested_score_block_size_ = DEFAULT_SCORE_BLOCK_SIZE;
+    mutable size_t score_block_size_ = DEFAULT_SCORE_BLOCK_SIZE;
+    mutable std::vector<size_t> score_block_offsets_ = { 0 };
+    mutable std::vector<int> score_block_last_ordinals_;
+    mutable std::vector<double> score_block_max_term_freqs_;
+
+    // --- CSR-массивы ---
+    // Начало списка каждого слова, размер - количество слов + 1
+    mutable std::vector<size_t> posting_offsets_ = { 0 };
+
+    // Формат RAW: параллельные массивы номеров документов и частот
+    mutable std::vector<int> posting_ordinals_;
+    mutable std::vector<double> posting_term_freqs_;
+
+    // Формат COMPRESSED: начало блоков каждого слова (размер - количество слов + 1),
+    // последний номер документа и смещение в потоке байт для каждого блока
+    mutable std::vector<size_t> term_block_offsets_ = { 0 };
+    mutable std::vector<uint32_t> block_last_ordinals_;
+    mutable std::vector<size_t> block_byte_offsets_;
+    mutable std::vector<uint8_t> compressed_postings_;
+
+    // --- Удаленные документы, еще не убранные из списков ---
+    // Битовая карта помеченных документов и признак ее непустоты
+    mutable DocumentBitmap deleted_documents_;
+    mutable bool has_deleted_documents_ = false;
+
+    // Количество помеченных документов в списке каждого слова
+    mutable std::vector<uint32_t> deleted_document_freqs_;
+
+    // Помеченные документы и их слова, ожидающие уплотнения
+    mutable std::vector<int> tombstones_;
+    mutable std::vector<int> tombstone_terms_;
+
+    // Документы и слова текущего уплотнения и его результат
+    mutable std::vector<int> compacting_tombstones_;
+    mutable std::vector<int> compacting_terms_;
+    mutable std::future<std::shared_ptr<MergedTerms>> compaction_;
+
+    double compaction_ratio_ = DEFAULT_COMPACTION_RATIO;
+
+    // --- Буфер записи ---
+    mutable std::vector<TermPosting> pending_postings_;
+    mutable std::unordered_set<int> pending_removals_;
+    // Слова удаленных документов, списки которых надо переписать
+    mutable std::vector<int> pending_removal_terms_;
+
+    // Признак непустого буфера (или устаревшего кэша IDF) и защита слияния
+    // от параллельных читателей и фонового уплотнения
+    mutable std::atomic<bool> has_pending_{ false };
+    mutable std::mutex merge_mutex_;
+
+    // Слияние без захвата мьютекса. Для parallel диапазоны слов сливаются в thread_pool
+    void MergeUnlocked(bool parallel, ThreadPool* thread_pool) const;
+
+    // Есть ли в буфере записи изменения списков, а не только кэша IDF
+    bool HasPendingPostings() const;
+
+    // Подмена CSR-массивов слитыми списками
+    void InstallMergedTerms(MergedTerms& merged_terms) const;
+
+    // Запуск фонового уплотнения помеченных документов, если их доля велика,
+    // буфер записи пуст и предыдущее уплотнение закончено
+    void ScheduleCompaction() const;
+
+    // Подмена списков результатом законченного уплотнения (wait - с ожиданием).
+    // Вызывается без параллельных читателей
+    void InstallCompaction(bool wait) const;
+
+    // Количество записей в списке слова, включая помеченные удаленными
+    size_t GetPostingCount(int term_id) const;
+
+    // Слияние слов [term_begin, term_end) в отдельные массивы диапазона
+    void MergeTerms(const MergeContext& context, size_t term_begin, size_t term_end, MergedTerms& merged_terms) const;
+
+    // Дописывание диапазона source, следующего за target, в конец target
+    static void AppendMergedTerms(const MergedTerms& source, MergedTerms& target);
+
+    // Захват merge_mutex_, слияние и пересчет кэша IDF
+    void MergeLocked(bool parallel, ThreadPool* thread_pool) const;
+
+    // Пересчет кэша IDF для всех слов
+    void UpdateInverseDocumentFreqs() const;
+
+    // Распаковка блока block сжатого списка слова term_id. Возвращает размер блока
+    size_t DecodeBlock(int term_id, size_t block, int* ordinals, uint32_t* counts) const;
+
+    // Частота слова по количеству вхождений
+    double GetTermFreq(int ordinal, uint32_t count) const;
+};
@@ -0,0 +1,408 @@
+#include "lsm_search_server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+
+using namespace std;
+
+LsmSearchServer::LsmSearchServer(string_view stop_words_text, size_t memtable_capacity, size_t merge_factor)
+    : stop_words_text_(stop_words_text)
+    , memtable_capacity_(max<size_t>(1, memtable_capacity))
+    , merge_factor_(max<size_t>(2, merge_factor))
+    , query_parser_(stop_words_text) {
+    version_ = make_shared<const Version>();
+}
+
+LsmSearchServer::~LsmSearchServer() {
+    shared_future<void> merge;
+    {
+        lock_guard guard(write_mutex_);
+        merge = merge_;
+    }
+    if (merge.valid()) {
+        merge.wait();
+    }
+}
+
+void LsmSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    lock_guard guard(write_mutex_);
+    const auto current = GetVersion();
+
+    // Номер должен быть уникален среди действующих документов всех сегментов
+    if (current->FindSegment(document_id) != nullptr) {
+        throw invalid_argument("Invalid document_id"s);
+    }
+
+    Version version = *current;
+    auto chunk = make_shared<SearchServer>(stop_words_text_);
+    chunk->AddDocument(document_id, document, status, ratings);
+    chunk->GetIndexByteSize();
+    version.memtable.push_back({ move(chunk), next_segment_id_++, nullptr });
+
+    // Маленькие части в конце memtable - меньше MEMTABLE_CHUNK_CAPACITY
+    // документов. Набравшиеся части сливаются в одну. Буфер записи части
+    // вливается до публикации, чтобы поиск не вливал его сам
+    const auto small_begin = find_if(version.memtable.rbegin(), version.memtable.rend(), [](const Segment& chunk) {
+        return static_cast<size_t>(chunk.server->GetDocumentCount()) >= MEMTABLE_CHUNK_CAPACITY;
+    }).base();
+    if (static_cast<size_t>(version.memtable.end() - small_begin) >= MEMTABLE_CHUNK_CAPACITY) {
+        auto merged = MergeServers({ small_begin, version.memtable.end() });
+        merged->GetIndexByteSize();
+        version.memtable.erase(small_begin, version.memtable.end());
+        version.memtable.push_back({ move(merged), next_segment_id_++, nullptr });
+    }
+
+    if (version.GetMemtableDocumentCount() >= memtable_capacity_) {
+        SealLocked(move(version));
+        return;
+    }
+    Publish(move(version));
+}
+
+void LsmSearchServer::RemoveDocument(int document_id) {
+    lock_guard guard(write_mutex_);
+    const auto current = GetVersion();
+    const Segment* segment = current->FindSegment(document_id);
+    if (segment == nullptr) {
+        return;
+    }
+
+    // Копируется только набор удаленных документов сегмента. Он ограничен
+    // перезаписью сегмента (см. ScheduleMerge), поэтому копия стоит O(sqrt(n))
+    // для сегмента из n документов. У части memtable набор не больше части
+    auto deletions = segment->deletions == nullptr
+        ? make_shared<SegmentDeletions>()
+        : make_shared<SegmentDeletions>(*segment->deletions);
+    deletions->Add(*segment->server, document_id);
+
+    Version version = *current;
+    version.FindSegmentById(segment->id)->deletions = move(deletions);
+    Publish(version);
+    ScheduleMerge(version);
+}
+
+int LsmSearchServer::GetDocumentCount() const {
+    const auto version = GetVersion();
+    int document_count = 0;
+    for (const Segment* segment : version->GetSegments()) {
+        document_count += segment->server->GetDocumentCount() - static_cast<int>(segment->GetDeletedCount());
+    }
+    return document_count;
+}
+
+void LsmSearchServer::Seal() {
+    lock_guard guard(write_mutex_);
+    const auto current = GetVersion();
+    if (current->memtable.empty()) {
+        return;
+    }
+    SealLocked(*current);
+}
+
+void LsmSearchServer::WaitForMerge() {
+    // Слияние публикует результат под write_mutex_, поэтому ожидание идет без него
+    shared_future<void> merge;
+    {
+        lock_guard guard(write_mutex_);
+        merge = merge_;
+    }
+    if (merge.valid()) {
+        merge.wait();
+    }
+
+    exception_ptr error;
+    {
+        lock_guard guard(write_mutex_);
+        error = merge_error_;
+        merge_error_ = nullptr;
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+}
+
+size_t LsmSearchServer::GetMemtableDocumentCount() const {
+    return GetVersion()->GetMemtableDocumentCount();
+}
+
+size_t LsmSearchServer::GetSealedSegmentCount() const {
+    const auto version = GetVersion();
+    return version->sealed_segments.size() + version->frozen_memtables.size();
+}
+
+void LsmSearchServer::SetThreadPool(shared_ptr<ThreadPool> thread_pool) {
+    thread_pool_ = move(thread_pool);
+}
+
+PreparedQuery LsmSearchServer::PrepareQuery(string_view raw_query) const {
+    return query_parser_.PrepareQuery(raw_query);
+}
+
+vector<Document> LsmSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
+    return FindTopDocuments(execution::seq, raw_query, status);
+}
+
+tuple<vector<string_view>, DocumentStatus> LsmSearchServer::MatchDocument(string_view raw_query, int document_id) const {
+    const auto version = GetVersion();
+    const Segment* segment = version->FindSegment(document_id);
+    if (segment == nullptr) {
+        throw out_of_range("Document id not found"s);
+    }
+    auto [words, status] = segment->server->MatchDocument(raw_query, document_id);
+
+    // Сегмент, в словарь которого указывают найденные слова, может освободиться
+    // после следующей записи. Слова заменяются такими же словами из текста запроса
+    const vector<string_view> query_words = SplitIntoWords(raw_query);
+    for (string_view& word : words) {
+        word = *find_if(query_words.begin(), query_words.end(), [word](string_view query_word) {
+            return query_word == word;
+        });
+    }
+    return { words, status };
+}
+
+void LsmSearchServer::SegmentDeletions::Add(const SearchServer& server, int document_id) {
+    document_ids.insert(document_id);
+    for (const auto& [word, freq] : server.GetWordFrequencies(document_id)) {
+        ++word_document_counts[word];
+    }
+}
+
+bool LsmSearchServer::Segment::HasDocument(int document_id) const {
+    return server->HasDocument(document_id)
+        && (deletions == nullptr || deletions->document_ids.count(document_id) == 0);
+}
+
+size_t LsmSearchServer::Segment::GetDeletedCount() const {
+    return deletions == nullptr ? 0 : deletions->document_ids.size();
+}
+
+vector<const LsmSearchServer::Segment*> LsmSearchServer::Version::GetSegments() const {
+    vector<const Segment*> segments;
+    segments.reserve(memtable.size() + frozen_memtables.size() * MEMTABLE_CHUNK_CAPACITY + sealed_segments.size());
+    for (const Segment& chunk : memtable) {
+        segments.push_back(&chunk);
+    }
+    for (const vector<Segment>& frozen_memtable : frozen_memtables) {
+        for (const Segment& chunk : frozen_memtable) {
+            segments.push_back(&chunk);
+        }
+    }
+    for (const Segment& segment : sealed_segments) {
+        segments.push_back(&segment);
+    }
+    return segments;
+}
+
+const LsmSearchServer::Segment* LsmSearchServer::Version::FindSegment(int document_id) const {
+    for (const Segment* segment : GetSegments()) {
+        if (segment->HasDocument(document_id)) {
+            return segment;
+        }
+    }
+    return nullptr;
+}
+
+LsmSearchServer::Segment* LsmSearchServer::Version::FindSegmentById(uint64_t id) {
+    vector<vector<Segment>*> groups = { &memtable, &sealed_segments };
+    for (vector<Segment>& frozen_memtable : frozen_memtables) {
+        groups.push_back(&frozen_memtable);
+    }
+    for (vector<Segment>* group : groups) {
+        const auto it = find_if(group->begin(), group->end(), [id](const Segment& segment) {
+            return segment.id == id;
+        });
+        if (it != group->end()) {
+            return &*it;
+        }
+    }
+    return nullptr;
+}
+
+size_t LsmSearchServer::Version::GetMemtableDocumentCount() const {
+    size_t document_count = 0;
+    for (const Segment& chunk : memtable) {
+        document_count += static_cast<size_t>(chunk.server->GetDocumentCount()) - chunk.GetDeletedCount();
+    }
+    return document_count;
+}
+
+shared_ptr<const LsmSearchServer::Version> LsmSearchServer::GetVersion() const {
+    return atomic_load(&version_);
+}
+
+void LsmSearchServer::Publish(Version version) {
+    atomic_store(&version_, shared_ptr<const Version>(make_shared<Version>(move(version))));
+}
+
+void LsmSearchServer::SealLocked(Version version) {
+    // Части не копируются: сжатый сегмент из них строит фоновое слияние,
+    // а до тех пор поиск идет по ним самим
+    version.frozen_memtables.push_back(move(version.memtable));
+    version.memtable.clear();
+    Publish(version);
+    ScheduleMerge(version);
+}
+
+void LsmSearchServer::ScheduleMerge(const Version& version) {
+    // Идущее слияние выберет сегменты этой версии само после текущего шага.
+    // Ошибка прошлого слияния сохранена в merge_error_ и сюда не пробрасывается:
+    // вызывающая запись уже опубликована
+    if (is_merge_running_) {
+        return;
+    }
+
+    vector<Segment> sources = SelectMergeSources(version);
+    if (sources.empty()) {
+        return;
+    }
+
+    // Слияния идут друг за другом в одном фоновом потоке, пока в текущей
+    // версии есть что сливать: сегменты, запечатанные во время слияния, и
+    // удаления не ждут следующей записи
+    is_merge_running_ = true;
+    merge_ = async(launch::async, [this, sources = move(sources)]() mutable {
+        try {
+            while (true) {
+                Merge(move(sources));
+                lock_guard guard(write_mutex_);
+                sources = SelectMergeSources(*GetVersion());
+                if (sources.empty()) {
+                    is_merge_running_ = false;
+                    return;
+                }
+            }
+        }
+        catch (...) {
+            lock_guard guard(write_mutex_);
+            merge_error_ = current_exception();
+            is_merge_running_ = false;
+        }
+    }).share();
+}
+
+vector<LsmSearchServer::Segment> LsmSearchServer::SelectMergeSources(const Version& version) const {
+    // Запечатанные memtable сжимаются первыми: поиск по их частям медленнее.
+    // Все накопившиеся за долгое слияние memtable сжимаются в один сегмент
+    if (!version.frozen_memtables.empty()) {
+        vector<Segment> sources;
+        for (const vector<Segment>& frozen_memtable : version.frozen_memtables) {
+            sources.insert(sources.end(), frozen_memtable.begin(), frozen_memtable.end());
+        }
+        return sources;
+    }
+
+    vector<Segment> sources = version.sealed_segments;
+    if (sources.size() >= merge_factor_) {
+        // Сливаются самые маленькие сегменты: размеры сегментов растут
+        // геометрически, и каждый документ переписывается O(log N) раз
+        sort(sources.begin(), sources.end(), [](const Segment& lhs, const Segment& rhs) {
+            return lhs.server->GetDocumentCount() - lhs.GetDeletedCount() < rhs.server->GetDocumentCount() - rhs.GetDeletedCount();
+        });
+        sources.resize(merge_factor_);
+        return sources;
+    }
+
+    // Сегмент из n документов, у которого удалено d >= sqrt(n), перезаписывается
+    // без удаленных. Набор удаленных копируется при каждом удалении, поэтому
+    // и копия, и доля перезаписи на одно удаление стоят O(sqrt(n))
+    const auto it = find_if(sources.begin(), sources.end(), [](const Segment& segment) {
+        const size_t deleted_count = segment.GetDeletedCount();
+        return deleted_count > 0 && deleted_count * deleted_count >= static_cast<size_t>(segment.server->GetDocumentCount());
+    });
+    if (it == sources.end()) {
+        return {};
+    }
+    return { *it };
+}
+
+shared_ptr<SearchServer> LsmSearchServer::MergeServers(const vector<Segment>& sources) const {
+    auto merged = make_shared<SearchServer>(stop_words_text_);
+    for (const Segment& source : sources) {
+        if (source.deletions == nullptr) {
+            merged->MergeFrom(*source.server);
+        }
+        else {
+            merged->MergeFrom(*source.server, source.deletions->document_ids);
+        }
+    }
+    return merged;
+}
+
+void LsmSearchServer::Merge(vector<Segment> sources) {
+    // Исходные сегменты неизменяемы, поэтому сливаются без блокировок.
+    // Документы, удаленные к началу слияния, в результат не переносятся
+    auto merged = MergeServers(sources);
+    merged->SetPostingFormat(PostingFormat::COMPRESSED);
+    merged->GetIndexByteSize();
+
+    lock_guard guard(write_mutex_);
+    Version version = *GetVersion();
+
+    // Пока шло слияние, RemoveDocument мог удалить из исходных сегментов еще
+    // документы. Они становятся удаленными документами результата. Сжатые
+    // сегменты и части запечатанных memtable убирает из версии только
+    // слияние, а слияния идут по одному, поэтому исходные сегменты в текущей
+    // версии есть
+    shared_ptr<SegmentDeletions> deletions;
+    for (const Segment& source : sources) {
+        const Segment* current = version.FindSegmentById(source.id);
+        if (current == nullptr || current->deletions == source.deletions) {
+            continue;
+        }
+        for (const int document_id : current->deletions->document_ids) {
+            if (source.deletions != nullptr && source.deletions->document_ids.count(document_id) > 0) {
+                continue;
+            }
+            if (deletions == nullptr) {
+                deletions = make_shared<SegmentDeletions>();
+            }
+            deletions->Add(*merged, document_id);
+        }
+    }
+
+    const auto is_source = [&sources](const Segment& segment) {
+        return any_of(sources.begin(), sources.end(), [&segment](const Segment& source) {
+            return source.id == segment.id;
+        });
+    };
+    version.sealed_segments.erase(
+        remove_if(version.sealed_segments.begin(), version.sealed_segments.end(), is_source),
+        version.sealed_segments.end());
+    version.frozen_memtables.erase(
+        remove_if(version.frozen_memtables.begin(), version.frozen_memtables.end(), [&is_source](const vector<Segment>& frozen_memtable) {
+            return is_source(frozen_memtable.front());
+        }),
+        version.frozen_memtables.end());
+    Segment merged_segment{ move(merged), next_segment_id_++, move(deletions) };
+    if (merged_segment.server->GetDocumentCount() > static_cast<int>(merged_segment.GetDeletedCount())) {
+        version.sealed_segments.push_back(move(merged_segment));
+    }
+    Publish(move(version));
+}
+
+PreparedQuery LsmSearchServer::WithGlobalStatistics(const PreparedQuery& query, const vector<const Segment*>& segments) {
+    const vector<string>& plus_words = query.GetPlusWords();
+    vector<size_t> document_freqs(plus_words.size(), 0);
+    int document_count = 0;
+
+    // Удаленные документы сегментов вычитаются из их статистики
+    for (const Segment* segment : segments) {
+        const vector<size_t> segment_freqs = segment->server->GetDocumentFreqs(query);
+        document_count += segment->server->GetDocumentCount() - static_cast<int>(segment->GetDeletedCount());
+        for (size_t i = 0; i < document_freqs.size(); ++i) {
+            document_freqs[i] += segment_freqs[i];
+            if (segment->deletions != nullptr) {
+                const auto& deleted_counts = segment->deletions->word_document_counts;
+                const auto it = deleted_counts.find(plus_words[i]);
+                if (it != deleted_counts.end()) {
+                    document_freqs[i] -= it->second;
+                }
+            }
+        }
+    }
+
+    return ::WithGlobalStatistics(query, document_freqs, document_count);
+}
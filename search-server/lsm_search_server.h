@@ -0,0 +1,318 @@
+#pragma once
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "document.h"
+#include "prepared_query.h"
+#include "search_server.h"
+#include "segmented_search_server.h"
+#include "thread_pool.h"
+
+// Документов в memtable, после которых он запечатывается
+const size_t DEFAULT_MEMTABLE_CAPACITY = 512;
+
+// Часть memtable меньше MEMTABLE_CHUNK_CAPACITY документов считается маленькой;
+// столько маленьких частей запись сливает в одну
+const size_t MEMTABLE_CHUNK_CAPACITY = 32;
+
+// Количество запечатанных сегментов, сливаемых фоновым слиянием в один
+const size_t DEFAULT_MERGE_FACTOR = 4;
+
+// Индекс в духе LSM-дерева. Новые документы попадают в memtable - список
+// небольших неизменяемых частей, поэтому стоимость AddDocument не растет с
+// размером индекса. Memtable с memtable_capacity документами запечатывается:
+// его части переходят в версию как есть, а записи идут в новый пустой memtable.
+// Сегмент со сжатым индексом из частей запечатанного memtable строит фоновое
+// слияние, и до его публикации поиск идет по самим частям, поэтому запись,
+// запечатавшая memtable, ничего не копирует. Когда сжатых сегментов набирается
+// merge_factor, самые маленькие из них тоже сливаются в один в фоновом потоке,
+// не задерживая запись и поиск.
+//
+// Поиск идет по memtable и запечатанным сегментам как по одному индексу с
+// общими IDF (как FindTopDocumentsInSegments), поэтому выдача и релевантность
+// те же, что у одного SearchServer с теми же документами.
+//
+// Чтение изолировано снимками (RCU): memtable и запечатанные сегменты образуют
+// версию индекса, и поиск работает с версией, взятой в начале запроса. Запись
+// публикует новую версию атомарной заменой shared_ptr, старая версия
+// освобождается, когда ее отпускает последний читатель. Поиск, AddDocument и
+// RemoveDocument можно вызывать из разных потоков одновременно; записи
+// выполняются по очереди.
+//
+// Запечатанные сегменты не меняются никогда. Удаление документа из них не
+// копирует сегмент: версия хранит для сегмента набор удаленных документов,
+// поиск их отбрасывает и не учитывает в IDF, а слияние и фоновая перезапись
+// сегмента с большим набором удаленных убирают их из списков.
+//
+// Memtable тоже не меняется на месте. Запись кладет документ в новую часть из
+// одного документа и публикует версию с ней, поэтому поиск не берет блокировок
+// и не ждет записей. Когда в конце memtable набирается MEMTABLE_CHUNK_CAPACITY
+// маленьких частей, запись сливает их в одну. До запечатывания документ
+// копируется один раз, одна запись копирует O(MEMTABLE_CHUNK_CAPACITY)
+// документов, а частей в memtable не больше
+// memtable_capacity / MEMTABLE_CHUNK_CAPACITY + MEMTABLE_CHUNK_CAPACITY:
+// копирование документа дороже поиска по лишней маленькой части на порядок.
+// Удаление из части memtable устроено так же, как из запечатанного сегмента
+class LsmSearchServer {
+public:
+    explicit LsmSearchServer(
+        std::string_view stop_words_text,
+        size_t memtable_capacity = DEFAULT_MEMTABLE_CAPACITY,
+        size_t merge_factor = DEFAULT_MERGE_FACTOR);
+
+    // Дожидается фонового слияния
+    ~LsmSearchServer();
+
+    LsmSearchServer(const LsmSearchServer&) = delete;
+    LsmSearchServer& operator=(const LsmSearchServer&) = delete;
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    // Документ попадает в набор удаленных своего сегмента или части memtable
+    // в новой версии, сами они не копируются
+    void RemoveDocument(int document_id);
+
+    int GetDocumentCount() const;
+
+    // Досрочное запечатывание memtable. Сжатый сегмент из него строится в
+    // фоновом потоке, см. WaitForMerge
+    void Seal();
+
+    // Ожидание фоновых слияний. Пробрасывает исключение из последнего
+    // неудавшегося слияния, если оно еще не было проброшено. Остальные методы
+    // ошибок фонового слияния не бросают: исходные сегменты при ошибке остаются
+    void WaitForMerge();
+
+    size_t GetMemtableDocumentCount() const;
+
+    // Сжатые сегменты и запечатанные memtable, еще не сжатые в сегменты
+    size_t GetSealedSegmentCount() const;
+
+    // Пул потоков для поиска по сегментам. Вызывается до начала работы с сервером
+    void SetThreadPool(std::shared_ptr<ThreadPool> thread_pool);
+
+    PreparedQuery PrepareQuery(std::string_view raw_query) const;
+
+    template <typename ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(
+        ExecutionPolicy&& policy,
+        const PreparedQuery& query,
+        DocumentPredicate document_predicate,
+        const SearchOptions& options) const;
+
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(
+        ExecutionPolicy&& policy,
+        const PreparedQuery& query,
+        DocumentStatus status,
+        const SearchOptions& options) const;
+
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(
+        ExecutionPolicy&& policy,
+        std::string_view raw_query,
+        DocumentStatus status = DocumentStatus::ACTUAL,
+        const SearchOptions& options = {}) const;
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const;
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+
+private:
+    // Документы сегмента, удаленные после его создания
+    struct SegmentDeletions {
+        std::unordered_set<int> document_ids;
+        // Количество удаленных документов с каждым словом. Слова указывают
+        // в словарь сервера сегмента
+        std::unordered_map<std::string_view, size_t> word_document_counts;
+
+        // Добавление документа document_id сервера server
+        void Add(const SearchServer& server, int document_id);
+    };
+
+    // Неизменяемый сегмент версии: запечатанный сегмент или часть memtable.
+    // Номер сегмента сохраняется при удалениях, по нему слияние находит свои
+    // исходные сегменты в новой версии
+    struct Segment {
+        std::shared_ptr<const SearchServer> server;
+        uint64_t id = 0;
+        // nullptr, если удаленных документов нет
+        std::shared_ptr<const SegmentDeletions> deletions;
+
+        bool HasDocument(int document_id) const;
+        size_t GetDeletedCount() const;
+    };
+
+    // Версия индекса. Не меняется после публикации
+    struct Version {
+        // Части memtable от старых к новым, без сжатия
+        std::vector<Segment> memtable;
+        // Части запечатанных memtable, которые фоновое слияние еще не сжало
+        // в сегменты, по memtable от старых к новым
+        std::vector<std::vector<Segment>> frozen_memtables;
+        // Сжатые сегменты
+        std::vector<Segment> sealed_segments;
+
+        // Части memtable, части запечатанных memtable и сжатые сегменты
+        std::vector<const Segment*> GetSegments() const;
+
+        // Сегмент с действующим документом или nullptr
+        const Segment* FindSegment(int document_id) const;
+
+        // Сегмент с номером id или nullptr
+        Segment* FindSegmentById(uint64_t id);
+
+        size_t GetMemtableDocumentCount() const;
+    };
+
+    const std::string stop_words_text_;
+    const size_t memtable_capacity_;
+    const size_t merge_factor_;
+
+    // Сервер без документов для разбора запросов: стоп-слова у всех сегментов общие
+    const SearchServer query_parser_;
+
+    // Текущая версия. Читается и заменяется только через std::atomic_load и
+    // std::atomic_store
+    std::shared_ptr<const Version> version_;
+
+    // Очередность записей, включая публикацию результата фонового слияния
+    std::mutex write_mutex_;
+
+    // Текущее фоновое слияние (не valid(), если слияний не было). Под write_mutex_
+    std::shared_future<void> merge_;
+
+    // Фоновое слияние еще выберет сегменты из текущей версии. Сбрасывается под
+    // write_mutex_ вместе с выбором, не нашедшим, что сливать, поэтому запись,
+    // увидевшая флаг, может не запускать слияние сама. Под write_mutex_
+    bool is_merge_running_ = false;
+
+    // Исключение неудавшегося фонового слияния для WaitForMerge. Под write_mutex_
+    std::exception_ptr merge_error_;
+
+    // Номер следующего нового сегмента. Под write_mutex_
+    uint64_t next_segment_id_ = 0;
+
+    std::shared_ptr<ThreadPool> thread_pool_;
+
+    std::shared_ptr<const Version> GetVersion() const;
+
+    // Публикация версии. Вызывается под write_mutex_
+    void Publish(Version version);
+
+    // Запечатывание memtable версии version: публикация версии, где его части
+    // перешли в frozen_memtables, а memtable пуст, и запуск фонового слияния,
+    // которое сожмет их в сегмент. Вызывается под write_mutex_
+    void SealLocked(Version version);
+
+    // Запуск фоновых слияний, если они не идут и в версии есть что сливать.
+    // Вызывается под write_mutex_
+    void ScheduleMerge(const Version& version);
+
+    // Сегменты для следующего слияния: части всех запечатанных memtable, если
+    // они есть, иначе merge_factor самых маленьких сжатых сегментов, если их
+    // достаточно, иначе сжатый сегмент с большим набором удаленных документов
+    // для перезаписи. Пустой список - сливать нечего.
+    // Вызывается под write_mutex_
+    std::vector<Segment> SelectMergeSources(const Version& version) const;
+
+    // Сервер с действующими документами сегментов sources, без сжатия
+    std::shared_ptr<SearchServer> MergeServers(const std::vector<Segment>& sources) const;
+
+    // Слияние sources в один сегмент без удаленных документов и публикация
+    // версии с ним. Документы, удаленные во время слияния, переходят в набор
+    // удаленных результата
+    void Merge(std::vector<Segment> sources);
+
+    // Копия запроса с IDF по сегментам segments без удаленных документов
+    static PreparedQuery WithGlobalStatistics(const PreparedQuery& query, const std::vector<const Segment*>& segments);
+
+    // document_predicate - предикат или DocumentStatus
+    template <typename ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsImpl(
+        ExecutionPolicy&& policy,
+        const PreparedQuery& query,
+        DocumentPredicate document_predicate,
+        const SearchOptions& options) const;
+
+    template <typename DocumentPredicate>
+    static bool IsAccepted(const DocumentPredicate& document_predicate, int document_id, DocumentStatus status, int rating);
+};
+
+
+template <typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> LsmSearchServer::FindTopDocuments(
+    ExecutionPolicy&& policy,
+    const PreparedQuery& query,
+    DocumentPredicate document_predicate,
+    const SearchOptions& options) const {
+    return FindTopDocumentsImpl(policy, query, document_predicate, options);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> LsmSearchServer::FindTopDocuments(
+    ExecutionPolicy&& policy,
+    const PreparedQuery& query,
+    DocumentStatus status,
+    const SearchOptions& options) const {
+    return FindTopDocumentsImpl(policy, query, status, options);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> LsmSearchServer::FindTopDocuments(
+    ExecutionPolicy&& policy,
+    std::string_view raw_query,
+    DocumentStatus status,
+    const SearchOptions& options) const {
+    return FindTopDocuments(policy, PrepareQuery(raw_query), status, options);
+}
+
+template <typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> LsmSearchServer::FindTopDocumentsImpl(
+    ExecutionPolicy&& policy,
+    const PreparedQuery& query,
+    DocumentPredicate document_predicate,
+    const SearchOptions& options) const {
+    // Версия удерживается до конца поиска, даже если запись опубликует новую.
+    // Сегменты версии не меняются, поэтому IDF посчитаны ровно по тем
+    // документам, среди которых идет поиск
+    const auto version = GetVersion();
+    const std::vector<const Segment*> segments = version->GetSegments();
+    const PreparedQuery global_query = WithGlobalStatistics(query, segments);
+
+    return MergeSegmentTopDocuments(policy, thread_pool_.get(), segments.size(), options.max_result_count,
+        [&](size_t i) {
+            const Segment& segment = *segments[i];
+            // Сегмент без удалений отбирает документы сам, в том числе по
+            // битовой карте статуса
+            if (segment.deletions == nullptr) {
+                return segment.server->FindTopDocuments(global_query, document_predicate, options);
+            }
+            const auto& deleted_ids = segment.deletions->document_ids;
+            return segment.server->FindTopDocuments(global_query,
+                [&](int document_id, DocumentStatus status, int rating) {
+                    return deleted_ids.count(document_id) == 0 && IsAccepted(document_predicate, document_id, status, rating);
+                },
+                options);
+        });
+}
+
+template <typename DocumentPredicate>
+bool LsmSearchServer::IsAccepted(const DocumentPredicate& document_predicate, int document_id, DocumentStatus status, int rating) {
+    if constexpr (std::is_same_v<DocumentPredicate, DocumentStatus>) {
+        return status == document_predicate;
+    }
+    else {
+        return document_predicate(document_id, status, rating);
+    }
+}
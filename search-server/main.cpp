@@ -60,6 +60,14 @@ int main() {
         //BenchmarkProcessQueries();
         //BenchmarkRemoveDocument();
         //BenchmarkMatchDocument();
+        //BenchmarkPostingCodec();
+        //BenchmarkPrunedRetrieval();
+        //BenchmarkConcurrentMap();
+        //BenchmarkSegmentedIndex();
+        //BenchmarkLsmIndex();
+        //BenchmarkAddDocuments();
+        //BenchmarkRemoveDocuments();
+        //BenchmarkRemoveDuplicates();
         BenchmarkFindTopDocuments();
     }
     return 0;
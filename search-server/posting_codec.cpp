@@ -0,0 +1,180 @@
+#include "posting_codec.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEARCH_SERVER_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// Длина значения в байтах, закодированная двумя битами (0 -> 1 байт, ..., 3 -> 4 байта)
+uint8_t GetLengthCode(uint32_t value) {
+    if (value < (1u << 8)) {
+        return 0;
+    }
+    if (value < (1u << 16)) {
+        return 1;
+    }
+    if (value < (1u << 24)) {
+        return 2;
+    }
+    return 3;
+}
+
+// Таблицы для декодирования группы из 4 значений по управляющему байту:
+// суммарная длина группы в байтах и маска перестановки байт для pshufb
+struct DecodeTables {
+    array<uint8_t, 256> group_lengths;
+    alignas(16) array<array<uint8_t, 16>, 256> shuffle_masks;
+
+    DecodeTables() {
+        for (int control = 0; control < 256; ++control) {
+            uint8_t position = 0;
+            for (int k = 0; k < 4; ++k) {
+                const int length = ((control >> (2 * k)) & 3) + 1;
+                for (int j = 0; j < 4; ++j) {
+                    // 0x80 в маске pshufb обнуляет байт результата
+                    shuffle_masks[control][4 * k + j] = j < length ? position++ : 0x80;
+                }
+            }
+            group_lengths[control] = position;
+        }
+    }
+};
+
+const DecodeTables& GetDecodeTables() {
+    static const DecodeTables tables;
+    return tables;
+}
+
+#ifdef SEARCH_SERVER_X86_SIMD
+
+__attribute__((target("ssse3")))
+const uint8_t* DecodeStreamVByteSsse3(const uint8_t* in, size_t count, uint32_t* values) {
+    const DecodeTables& tables = GetDecodeTables();
+    const uint8_t* control = in;
+    const uint8_t* data = in + (count + 3) / 4;
+
+    // Полные группы по 4 значения: одна загрузка, одна перестановка, одна запись
+    const size_t group_count = count / 4;
+    for (size_t group = 0; group < group_count; ++group) {
+        const uint8_t key = control[group];
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+        const __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(tables.shuffle_masks[key].data()));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + 4 * group), _mm_shuffle_epi8(bytes, mask));
+        data += tables.group_lengths[key];
+    }
+
+    // Неполная последняя группа декодируется скалярно
+    for (size_t i = group_count * 4; i < count; ++i) {
+        const int length = ((control[i / 4] >> (2 * (i % 4))) & 3) + 1;
+        uint32_t value = 0;
+        memcpy(&value, data, length);
+        values[i] = value;
+        data += length;
+    }
+
+    return data;
+}
+
+__attribute__((target("sse2")))
+void DecodeDeltasSse2(uint32_t* values, size_t count, uint32_t base) {
+    __m128i previous = _mm_set1_epi32(static_cast<int>(base));
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        // Префиксная сумма внутри 4 значений за два сдвига
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi32(x, previous);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), x);
+        previous = _mm_shuffle_epi32(x, 0xFF);
+    }
+
+    uint32_t last = static_cast<uint32_t>(_mm_cvtsi128_si32(previous));
+    for (; i < count; ++i) {
+        last += values[i];
+        values[i] = last;
+    }
+}
+
+#endif
+
+} // namespace
+
+void EncodeStreamVByte(const uint32_t* values, size_t count, vector<uint8_t>& out) {
+    const size_t control_begin = out.size();
+    out.resize(control_begin + (count + 3) / 4, 0);
+
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t code = GetLengthCode(values[i]);
+        out[control_begin + i / 4] |= code << (2 * (i % 4));
+
+        // Байты значения в порядке little-endian
+        for (int j = 0; j <= code; ++j) {
+            out.push_back(static_cast<uint8_t>(values[i] >> (8 * j)));
+        }
+    }
+}
+
+const uint8_t* DecodeStreamVByteScalar(const uint8_t* in, size_t count, uint32_t* values) {
+    const uint8_t* control = in;
+    const uint8_t* data = in + (count + 3) / 4;
+
+    for (size_t i = 0; i < count; ++i) {
+        const int length = ((control[i / 4] >> (2 * (i % 4))) & 3) + 1;
+        uint32_t value = 0;
+        for (int j = 0; j < length; ++j) {
+            value |= static_cast<uint32_t>(data[j]) << (8 * j);
+        }
+        values[i] = value;
+        data += length;
+    }
+
+    return data;
+}
+
+const uint8_t* DecodeStreamVByte(const uint8_t* in, size_t count, uint32_t* values) {
+#ifdef SEARCH_SERVER_X86_SIMD
+    if (IsSimdDecodingAvailable()) {
+        return DecodeStreamVByteSsse3(in, count, values);
+    }
+#endif
+    return DecodeStreamVByteScalar(in, count, values);
+}
+
+void EncodeDeltas(uint32_t* values, size_t count, uint32_t base) {
+    uint32_t previous = base;
+    for (size_t i = 0; i < count; ++i) {
+        const uint32_t current = values[i];
+        values[i] = current - previous;
+        previous = current;
+    }
+}
+
+void DecodeDeltas(uint32_t* values, size_t count, uint32_t base) {
+#ifdef SEARCH_SERVER_X86_SIMD
+    DecodeDeltasSse2(values, count, base);
+#else
+    uint32_t previous = base;
+    for (size_t i = 0; i < count; ++i) {
+        previous += values[i];
+        values[i] = previous;
+    }
+#endif
+}
+
+bool IsSimdDecodingAvailable() {
+#ifdef SEARCH_SERVER_X86_SIMD
+    static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+    return has_ssse3;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Кодек StreamVByte для сжатия списков документов.
+// Значения кодируются группами по 4: один управляющий байт хранит длины
+// (1-4 байта) четырех значений, сами байты значений лежат отдельным потоком.
+// Такой формат декодируется одной инструкцией pshufb на группу (SSSE3),
+// при отсутствии SSSE3 используется скалярная версия
+
+// Запас байт в конце буфера: SIMD-декодер читает данные блоками по 16 байт
+const size_t STREAM_VBYTE_PADDING = 16;
+
+// Дописывает в out закодированные count значений: сначала (count + 3) / 4
+// управляющих байт, затем байты значений
+void EncodeStreamVByte(const uint32_t* values, size_t count, std::vector<uint8_t>& out);
+
+// Декодирует count значений в values. Возвращает указатель на байт, следующий
+// за закодированными данными. За концом данных должно быть не меньше
+// STREAM_VBYTE_PADDING доступных для чтения байт
+const uint8_t* DecodeStreamVByte(const uint8_t* in, size_t count, uint32_t* values);
+
+// Скалярная версия декодера. Используется как запасной вариант и в тестах
+const uint8_t* DecodeStreamVByteScalar(const uint8_t* in, size_t count, uint32_t* values);
+
+// Разностное кодирование возрастающей последовательности на месте:
+// values[i] заменяется на values[i] - values[i - 1], первое значение - на values[0] - base
+void EncodeDeltas(uint32_t* values, size_t count, uint32_t base);
+
+// Обратное преобразование (префиксная сумма), на x86 - через SSE2
+void DecodeDeltas(uint32_t* values, size_t count, uint32_t base);
+
+// Признак того, что процессор поддерживает SIMD-декодирование
+bool IsSimdDecodingAvailable();
@@ -0,0 +1,89 @@
+#pragma once
+#include <algorithm>
+#include <climits>
+
+#include "inverted_index.h"
+
+// Курсор по списку документов одного слова запроса для обхода
+// документ-за-документом (DAAT). Хранит вклад слова в релевантность текущего
+// документа и верхние оценки этого вклада по всему списку и по блокам оценок.
+// Блочный указатель движется независимо от позиции в списке (shallow skip):
+// оценку блока можно узнать, не разбирая его записи
+class PostingCursor {
+public:
+    // Номер документа исчерпанного курсора - больше любого реального номера
+    static constexpr int END = INT_MAX;
+
+    PostingCursor(InvertedIndex::PostingList postings, double inverse_document_freq, double max_score, int term_order)
+        : postings_(postings)
+        , inverse_document_freq_(inverse_document_freq)
+        , max_score_(max_score)
+        , term_order_(term_order) {
+    }
+
+    // Внутренний номер текущего документа или END
+    int GetOrdinal() const {
+        return position_ < postings_.size ? postings_.ordinals[position_] : END;
+    }
+
+    // Вклад слова в релевантность текущего документа
+    double GetScore() const {
+        return postings_.term_freqs[position_] * inverse_document_freq_;
+    }
+
+    // Верхняя оценка вклада слова в релевантность любого документа
+    double GetMaxScore() const {
+        return max_score_;
+    }
+
+    // Позиция слова в запросе. Вклады слов складываются в этом порядке,
+    // чтобы релевантность совпадала с полным перебором до последнего бита
+    int GetTermOrder() const {
+        return term_order_;
+    }
+
+    void Next() {
+        ++position_;
+    }
+
+    // Переход к первому документу с номером не меньше ordinal. Галопирующий
+    // поиск: шаг удваивается, пока не перескочит цель, затем бинарный поиск
+    void SkipTo(int ordinal) {
+        size_t low = position_;
+        size_t high = position_;
+        size_t step = 1;
+        while (high < postings_.size && postings_.ordinals[high] < ordinal) {
+            low = high;
+            high += step;
+            step *= 2;
+        }
+        high = std::min(high, postings_.size);
+        position_ = std::lower_bound(postings_.ordinals + low, postings_.ordinals + high, ordinal) - postings_.ordinals;
+    }
+
+    // Переход блочного указателя к первому блоку, последний документ которого
+    // не меньше ordinal. Позиция в списке не меняется
+    void ShallowSkipTo(int ordinal) {
+        while (block_ < postings_.block_count && postings_.block_last_ordinals[block_] < ordinal) {
+            ++block_;
+        }
+    }
+
+    // Последний документ текущего блока или END, если блоки кончились
+    int GetBlockLastOrdinal() const {
+        return block_ < postings_.block_count ? postings_.block_last_ordinals[block_] : END;
+    }
+
+    // Верхняя оценка вклада слова в документы текущего блока, 0 - если блоки кончились
+    double GetBlockMaxScore() const {
+        return block_ < postings_.block_count ? postings_.block_max_term_freqs[block_] * inverse_document_freq_ : 0.0;
+    }
+
+private:
+    InvertedIndex::PostingList postings_;
+    size_t position_ = 0;
+    size_t block_ = 0;
+    double inverse_document_freq_;
+    double max_score_;
+    int term_order_;
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+class SearchServer;
+
+// Разобранный поисковый запрос. Создается один раз методом SearchServer::PrepareQuery
+// и передается в FindTopDocuments и MatchDocument вместо строки: разбор, проверка
+// слов, отбрасывание стоп-слов и удаление повторов при этом не повторяются.
+//
+// Запрос хранит собственные копии слов, поэтому не зависит от исходной строки и
+// подходит для любого сервера. Номера слов запоминаются в словаре подготовившего
+// сервера и используются им напрямую; другой сервер находит номера по словам.
+// Стоп-слова отброшены по списку подготовившего сервера
+class PreparedQuery {
+public:
+    // Плюс и минус слова запроса без повторов, по возрастанию
+    const std::vector<std::string>& GetPlusWords() const {
+        return plus_words_;
+    }
+
+    const std::vector<std::string>& GetMinusWords() const {
+        return minus_words_;
+    }
+
+    // IDF плюс слов в порядке GetPlusWords(), заменяющие статистику сервера.
+    // Нужны для поиска по нескольким индексам с общей статистикой, чтобы
+    // релевантность не зависела от того, в каком индексе лежит документ.
+    // Пустой набор (по умолчанию) - сервер берет IDF из своего индекса.
+    // Бросает invalid_argument, если непустой набор не совпадает по размеру
+    // с GetPlusWords()
+    void SetInverseDocumentFreqs(std::vector<double> inverse_document_freqs) {
+        if (!inverse_document_freqs.empty() && inverse_document_freqs.size() != plus_words_.size()) {
+            throw std::invalid_argument("Inverse document freqs do not match plus words");
+        }
+        plus_inverse_document_freqs_ = std::move(inverse_document_freqs);
+    }
+
+    const std::vector<double>& GetInverseDocumentFreqs() const {
+        return plus_inverse_document_freqs_;
+    }
+
+private:
+    friend class SearchServer;
+
+    std::vector<std::string> plus_words_;
+    std::vector<std::string> minus_words_;
+
+    // Идентификатор словаря подготовившего сервера и номера слов в нем
+    // (NO_TERM для слов, которых в словаре не было)
+    uint64_t dictionary_uid_ = 0;
+    std::vector<int> plus_term_ids_;
+    std::vector<int> minus_term_ids_;
+
+    std::vector<double> plus_inverse_document_freqs_;
+};
@@ -3,47 +3,47 @@
 #include <execution>
 #include <string_view>
 
+#include "thread_pool.h"
+
 
 std::vector<std::vector<Document>> ProcessQueries(
 	const SearchServer& search_server,
 	const std::vector<std::string>& queries) {
 
-	// Контейнер для сбора данных для вывода
-	std::vector<std::vector<Document>> documents_lists(queries.size());
-
 	// Простое, но не эффективное решение
 	// for (const std::string& query : queries) {
 	// 	 documents_lists.push_back(search_server.FindTopDocuments(query));
 	// }
 
-	std::transform(
-		std::execution::par,			// Включаем параллельное вычисление
-		queries.begin(), queries.end(),	// Начало и конец входного диапазона
-		documents_lists.begin(),		// Начало выходного диапазона
-		[&search_server](std::string_view query) { return search_server.FindTopDocuments(query); }
-	);
+	// Разбираем запросы параллельно. Как и поиск, разбор выполняется на пуле
+	// потоков сервера, если он задан
+	const auto prepared_queries = search_server.PrepareQueries(std::execution::par, queries);
 
-	return documents_lists;
+	// Пакетный поиск: каждое слово пакета находится в индексе один раз,
+	// списки общих слов проходятся один раз для группы запросов
+	return search_server.FindTopDocumentsBatch(std::execution::par, prepared_queries);
 }
 
-std::list<Document> ProcessQueriesJoined(
+JoinedDocuments ProcessQueriesJoined(
 	const SearchServer& search_server,
 	const std::vector<std::string>& queries) {
 
-	// Контейнер данных для вывода
-	std::list<Document> found_documents;
-
 	// Проводим параллельный поиск документов
 	auto documents_lists = ProcessQueries(search_server, queries);
 
-	// Простое, но не самое эффективное решение
-	// Преобразуем вектор векторов в единый список
-	for (auto& documents : documents_lists) {
-		// Каждый отдельно найденный документ всталяем в список
-		for (auto& document : documents) {
-			found_documents.push_back(document);
-		}
+	// Начало выдачи каждого запроса в общем буфере - префиксные суммы размеров выдач.
+	// Сумм по одной на запрос, поэтому они считаются в вызывающем потоке
+	std::vector<size_t> offsets(documents_lists.size() + 1, 0);
+	for (size_t i = 0; i < documents_lists.size(); ++i) {
+		offsets[i + 1] = offsets[i] + documents_lists[i].size();
 	}
 
-	return found_documents;
-}
\ No newline at end of file
+	// Каждый запрос переносит свою выдачу на свое место параллельно с остальными,
+	// на том же пуле потоков сервера, что и поиск
+	std::vector<Document> found_documents(offsets.back());
+	ForEachIndex(std::execution::par, search_server.GetThreadPool().get(), documents_lists.size(), [&](size_t i) {
+		std::move(documents_lists[i].begin(), documents_lists[i].end(), found_documents.begin() + offsets[i]);
+	});
+
+	return { std::move(found_documents), std::move(offsets) };
+}
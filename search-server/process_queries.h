@@ -1,16 +1,59 @@
 #pragma once
 #include <vector>
 #include <string>
-#include <list>
 
 #include "document.h"
+#include "paginator.h"
 #include "search_server.h"
 
 
+// Найденные документы пакета запросов в одном непрерывном буфере.
+// Документы i-го запроса лежат в [offsets[i], offsets[i + 1])
+class JoinedDocuments {
+public:
+	using Iterator = std::vector<Document>::const_iterator;
+
+	JoinedDocuments(std::vector<Document> documents, std::vector<size_t> offsets)
+		: documents_(std::move(documents))
+		, offsets_(std::move(offsets)) {
+	}
+
+	// Обход всех документов подряд в порядке запросов
+	Iterator begin() const {
+		return documents_.begin();
+	}
+
+	Iterator end() const {
+		return documents_.end();
+	}
+
+	size_t size() const {
+		return documents_.size();
+	}
+
+	bool empty() const {
+		return documents_.empty();
+	}
+
+	size_t GetQueryCount() const {
+		return offsets_.size() - 1;
+	}
+
+	// Документы query_index-го запроса
+	IteratorRange<Iterator> GetQueryDocuments(size_t query_index) const {
+		return { documents_.begin() + offsets_[query_index], documents_.begin() + offsets_[query_index + 1] };
+	}
+
+private:
+	std::vector<Document> documents_;
+	std::vector<size_t> offsets_;
+};
+
+
 std::vector<std::vector<Document>> ProcessQueries(
 	const SearchServer& search_server,
 	const std::vector<std::string>& queries);
 
-std::list<Document> ProcessQueriesJoined(
+JoinedDocuments ProcessQueriesJoined(
 	const SearchServer& search_server,
-	const std::vector<std::string>& queries);
\ No newline at end of file
+	const std::vector<std::string>& queries);
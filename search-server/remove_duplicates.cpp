@@ -1,39 +1,111 @@
 #include "remove_duplicates.h"
+#include <algorithm>
+#include <cstdint>
+#include <execution>
 #include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "thread_pool.h"
 
 using namespace std;
 
+namespace {
+
+// Отпечаток набора слов документа
+struct WordSetFingerprint {
+    uint64_t low = 0;
+    uint64_t high = 0;
+
+    bool operator==(const WordSetFingerprint& other) const {
+        return low == other.low && high == other.high;
+    }
+};
+
+struct WordSetFingerprintHasher {
+    size_t operator()(const WordSetFingerprint& fingerprint) const {
+        // Половины отпечатка уже перемешаны, достаточно одной из них
+        return static_cast<size_t>(fingerprint.low);
+    }
+};
+
+// Финализатор splitmix64: близкие номера слов дают независимые на вид значения
+uint64_t MixBits(uint64_t value) {
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+// Отпечаток - сумма хешей слов по модулю 2^64 в каждой половине: сумма не
+// зависит от порядка слов, а повторов в наборе нет. Сумма линейна, и разные
+// наборы могут дать один отпечаток, поэтому совпадение отпечатков только
+// отбирает кандидатов, а дубликат подтверждается сравнением наборов
+WordSetFingerprint GetWordSetFingerprint(const vector<int>& term_ids) {
+    WordSetFingerprint fingerprint;
+    for (const int term_id : term_ids) {
+        const uint64_t term = static_cast<uint32_t>(term_id);
+        fingerprint.low += MixBits(term);
+        fingerprint.high += MixBits(term ^ 0x5851f42d4c957f2dULL);
+    }
+    return fingerprint;
+}
+
+// Номера слов документа по возрастанию
+vector<int> GetSortedTermIds(const SearchServer& search_server, int document_id) {
+    vector<int> term_ids = search_server.GetDocumentTermIds(document_id);
+    sort(term_ids.begin(), term_ids.end());
+    return term_ids;
+}
+
+} // namespace
+
 void RemoveDuplicates(SearchServer& search_server, ostream& out) {
-    //Список id дубликатов
-    set<int> duplicates_id;
-
-    // Список уникальных наборов слов
-    vector<set<string>> unique_sets_of_words;
-
-    // Проходим по списку документов в базе
-    for (int doc_id : search_server) {
-        //Составляем список слов документа
-        set<string> id_words;
-        for (auto& [word, id] : search_server.GetWordFrequencies(doc_id)) {
-            string word_string{ word };
-            id_words.insert(word_string);
+    // Номера документов по возрастанию: из одинаковых наборов слов остается
+    // документ, встретившийся первым, то есть с меньшим номером
+    const vector<int> document_ids(search_server.begin(), search_server.end());
+
+    // Отпечатки считаются параллельно на пуле сервера: сервер при этом только
+    // читается
+    vector<WordSetFingerprint> fingerprints(document_ids.size());
+    const SearchServer& server = search_server;
+    ForEachIndex(execution::par, server.GetThreadPool().get(), document_ids.size(), [&](size_t i) {
+        fingerprints[i] = GetWordSetFingerprint(server.GetDocumentTermIds(document_ids[i]));
+    });
+
+    // Первый документ каждого набора слов по отпечатку набора. У разных
+    // наборов с одним отпечатком - по документу на набор
+    unordered_multimap<WordSetFingerprint, int, WordSetFingerprintHasher> unique_documents;
+    unique_documents.reserve(document_ids.size());
+
+    // Список id дубликатов, по возрастанию
+    vector<int> duplicate_ids;
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        const int document_id = document_ids[i];
+        const auto [first, last] = unique_documents.equal_range(fingerprints[i]);
+
+        // Наборы слов сравниваются только при совпадении отпечатков, то есть
+        // почти всегда только для настоящих дубликатов
+        bool is_duplicate = false;
+        if (first != last) {
+            const vector<int> term_ids = GetSortedTermIds(server, document_id);
+            is_duplicate = any_of(first, last, [&](const auto& unique_document) {
+                return GetSortedTermIds(server, unique_document.second) == term_ids;
+            });
         }
 
-        //Проверяем, что такого списка еще не было
-        bool not_unique = count(unique_sets_of_words.begin(), unique_sets_of_words.end(), id_words);
- 
-        //Если был, то документ - дубликат. Если нет - то добавляем спсиок слов как уникальный
-        if (not_unique) {
-            duplicates_id.insert(doc_id);
+        if (is_duplicate) {
+            duplicate_ids.push_back(document_id);
         }
         else {
-            unique_sets_of_words.push_back(id_words);
+            unique_documents.emplace(fingerprints[i], document_id);
         }
     }
 
-    //Удалям документы по списку дубликатов
-    for (auto id : duplicates_id) {
-        out << "Found duplicate document id "s << id << endl;
-        search_server.RemoveDocument(id);
+    for (const int id : duplicate_ids) {
+        out << "Found duplicate document id "s << id << '\n';
     }
-}
\ No newline at end of file
+
+    // Пакетное удаление переписывает список каждого затронутого слова один раз
+    search_server.RemoveDocuments(execution::par, duplicate_ids);
+}
@@ -2,4 +2,9 @@
 #include "search_server.h"
 #include <iostream>
 
-void RemoveDuplicates(SearchServer& search_server, std::ostream& out = std::cout);
\ No newline at end of file
+// Удаление документов с тем же набором слов, что у документа с меньшим номером.
+// Набор слов документа сводится к 128-битному отпечатку номеров слов, не
+// зависящему от их порядка; отпечатки считаются параллельно на пуле потоков
+// сервера, а повторы ищутся хеш-таблицей, поэтому проход линеен по числу
+// документов. Совпадение отпечатков подтверждается сравнением наборов слов
+void RemoveDuplicates(SearchServer& search_server, std::ostream& out = std::cout);
@@ -0,0 +1,57 @@
+#include "score_accumulator.h"
+
+#include <algorithm>
+
+using namespace std;
+
+void ScoreAccumulator::Reset(size_t size) {
+    touched_.clear();
+
+    // При переполнении эпохи старые отметки могли бы совпасть с новыми
+    ++epoch_;
+    if (epoch_ == 0) {
+        fill(marks_.begin(), marks_.end(), 0);
+        epoch_ = 1;
+    }
+
+    if (marks_.size() < size) {
+        marks_.resize(size, 0);
+        scores_.resize(size, 0.0);
+    }
+}
+
+const vector<int>& ScoreAccumulator::GetTouched() {
+    sort(touched_.begin(), touched_.end());
+    return touched_;
+}
+
+ScoreAccumulator& GetThreadScoreAccumulator() {
+    thread_local ScoreAccumulator accumulator;
+    return accumulator;
+}
+
+void QueryGroupAccumulator::Reset(size_t size) {
+    touched_.clear();
+
+    ++epoch_;
+    if (epoch_ == 0) {
+        fill(marks_.begin(), marks_.end(), 0);
+        epoch_ = 1;
+    }
+
+    if (marks_.size() < size) {
+        marks_.resize(size, 0);
+        query_masks_.resize(size, 0);
+        scores_.resize(size * MAX_QUERY_COUNT, 0.0);
+    }
+}
+
+const vector<int>& QueryGroupAccumulator::GetTouched() {
+    sort(touched_.begin(), touched_.end());
+    return touched_;
+}
+
+QueryGroupAccumulator& GetThreadQueryGroupAccumulator() {
+    thread_local QueryGroupAccumulator accumulator;
+    return accumulator;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Плотный накопитель релевантности, индексируемый внутренним номером документа.
+// Вместо очистки всего массива между запросами используется эпоха: документ
+// считается затронутым текущим запросом, только если его отметка равна эпохе.
+// Поэтому сброс стоит O(1), а проход по результатам - O(затронутых документов).
+// Массивы не освобождаются между запросами и растут только вместе с индексом
+class ScoreAccumulator {
+public:
+    // Подготовка к новому запросу по индексу из size документов
+    void Reset(size_t size);
+
+    // Увеличение релевантности документа
+    void Add(int ordinal, double score) {
+        if (marks_[ordinal] == epoch_) {
+            scores_[ordinal] += score;
+        }
+        else {
+            marks_[ordinal] = epoch_;
+            scores_[ordinal] = score;
+            touched_.push_back(ordinal);
+        }
+    }
+
+    // Документ затронут текущим запросом
+    bool IsScored(int ordinal) const {
+        return marks_[ordinal] == epoch_;
+    }
+
+    double GetScore(int ordinal) const {
+        return scores_[ordinal];
+    }
+
+    // Затронутые запросом документы по возрастанию номера
+    const std::vector<int>& GetTouched();
+
+private:
+    // Отметка документа: равна epoch_, если документ затронут текущим запросом
+    std::vector<uint32_t> marks_;
+    std::vector<double> scores_;
+    std::vector<int> touched_;
+    uint32_t epoch_ = 0;
+};
+
+// Накопитель текущего потока, переиспользуемый всеми запросами этого потока
+ScoreAccumulator& GetThreadScoreAccumulator();
+
+// Накопитель релевантности для группы запросов, вычисляемых вместе. Список
+// документов слова проходится один раз, и вклад документа прибавляется сразу
+// всем запросам группы с этим словом. Релевантности документа для запросов
+// группы лежат рядом, в одной строке кэша. Сброс, как у ScoreAccumulator, - по эпохе
+class QueryGroupAccumulator {
+public:
+    // Наибольшее количество запросов в группе: по биту маски на запрос
+    static const size_t MAX_QUERY_COUNT = 8;
+
+    void Reset(size_t size);
+
+    // Увеличение релевантности документа для запросов группы из query_mask
+    void Add(int ordinal, uint8_t query_mask, double score) {
+        if (marks_[ordinal] != epoch_) {
+            marks_[ordinal] = epoch_;
+            query_masks_[ordinal] = 0;
+            touched_.push_back(ordinal);
+        }
+        double* scores = &scores_[static_cast<size_t>(ordinal) * MAX_QUERY_COUNT];
+        const uint8_t scored_mask = query_masks_[ordinal];
+        for (size_t query = 0; (query_mask >> query) != 0; ++query) {
+            if ((query_mask >> query) & 1) {
+                scores[query] = ((scored_mask >> query) & 1) ? scores[query] + score : score;
+            }
+        }
+        query_masks_[ordinal] = scored_mask | query_mask;
+    }
+
+    // Запросы группы, затронувшие документ
+    uint8_t GetQueryMask(int ordinal) const {
+        return query_masks_[ordinal];
+    }
+
+    double GetScore(int ordinal, size_t query) const {
+        return scores_[static_cast<size_t>(ordinal) * MAX_QUERY_COUNT + query];
+    }
+
+    // Затронутые группой документы по возрастанию номера
+    const std::vector<int>& GetTouched();
+
+private:
+    std::vector<uint32_t> marks_;
+    std::vector<uint8_t> query_masks_;
+    std::vector<double> scores_;
+    std::vector<int> touched_;
+    uint32_t epoch_ = 0;
+};
+
+// Накопитель групп запросов текущего потока
+QueryGroupAccumulator& GetThreadQueryGroupAccumulator();
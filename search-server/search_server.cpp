@@ -2,6 +2,7 @@
 #include <cmath>
 
 #include <stdexcept>
+#include <thread>
 
 #include "search_server.h"
 
@@ -14,26 +15,91 @@ SearchServer::SearchServer(const string_view stop_words_text)
 
 void SearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
     // Проверяем, что номер документа валиден
-    if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+    if ((document_id < 0) || (document_id_to_ordinal_.count(document_id) > 0)) {
         throw invalid_argument("Invalid document_id"s);
     }
 
     // Разбиваем строку текста документа на слова, исключая стоп-слова
     auto words = SplitIntoWordsNoStop(document);
 
-    //Расчет частоты слова и добавление ее в словари
-    const double inv_word_count = 1.0 / words.size();
+    // Считаем количество вхождений каждого слова документа, присваивая словам номера
+    map<int, int> term_counts;
+    for (auto& word : words) {
+        ++term_counts[terms_.AddTerm(word)];
+    }
 
-    // Берем конеретный словарь из словаря документов
-    map<string, double>& words_in_doc = documents_to_word_freqs_[document_id];
+    AddDocumentTerms(document_id, status, ComputeAverageRating(ratings), static_cast<int>(words.size()), term_counts);
+}
 
-    // Считаем частоту слова в документе
-    for (auto& word : words) {
-        word_to_document_freqs_[string{ word }][document_id] += inv_word_count;
-        words_in_doc[string{ word }] += inv_word_count;
+void SearchServer::AddDocuments(const vector<DocumentInput>& documents) {
+    AddDocumentsImpl(execution::seq, documents);
+}
+
+void SearchServer::AddDocuments(const execution::sequenced_policy& policy, const vector<DocumentInput>& documents) {
+    AddDocumentsImpl(policy, documents);
+}
+
+void SearchServer::AddDocuments(const execution::parallel_policy& policy, const vector<DocumentInput>& documents) {
+    AddDocumentsImpl(policy, documents);
+}
+
+void SearchServer::MergeFrom(const SearchServer& source) {
+    MergeFrom(source, {});
+}
+
+void SearchServer::MergeFrom(const SearchServer& source, const unordered_set<int>& skipped_ids) {
+    for (const int document_id : source.document_ids_) {
+        if (skipped_ids.count(document_id) == 0 && document_id_to_ordinal_.count(document_id) > 0) {
+            throw invalid_argument("Invalid document_id"s);
+        }
+    }
+
+    for (const int document_id : source.document_ids_) {
+        if (skipped_ids.count(document_id) > 0) {
+            continue;
+        }
+        const int source_ordinal = source.document_id_to_ordinal_.at(document_id);
+        const int word_count = source.index_.GetWordCount(source_ordinal);
+
+        // Количество вхождений восстанавливается из частоты так же, как при
+        // перекодировании индекса, и дает ту же частоту при добавлении
+        map<int, int> term_counts;
+        for (const auto& [word, term_freq] : source.document_word_freqs_[source_ordinal]) {
+            term_counts.emplace(terms_.AddTerm(word), static_cast<int>(lround(term_freq * word_count)));
+        }
+
+        AddDocumentTerms(document_id, source.document_statuses_[source_ordinal],
+            source.document_ratings_[source_ordinal], word_count, term_counts);
+    }
+}
+
+bool SearchServer::HasDocument(int document_id) const {
+    return document_id_to_ordinal_.count(document_id) > 0;
+}
+
+void SearchServer::AddDocumentTerms(int document_id, DocumentStatus status, int rating, int word_count, const map<int, int>& term_counts) {
+    const double inv_word_count = 1.0 / word_count;
+
+    // Выдаем документу следующий внутренний номер
+    const int ordinal = static_cast<int>(document_external_ids_.size());
+
+    // Берем конеретный словарь из словаря документов. Частота считается так же,
+    // как в индексе: количество вхождений, умноженное на обратную длину документа
+    map<string_view, double> words_in_doc;
+    for (const auto [term_id, count] : term_counts) {
+        words_in_doc.emplace(terms_.GetWord(term_id), count * inv_word_count);
     }
 
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
+    // Отправляем документ в буфер записи индекса
+    index_.AddDocument(ordinal, word_count, { term_counts.begin(), term_counts.end() });
+
+    // Заполняем колонки свойств документа
+    document_id_to_ordinal_.emplace(document_id, ordinal);
+    document_external_ids_.push_back(document_id);
+    document_ratings_.push_back(rating);
+    document_statuses_.push_back(status);
+    status_documents_[static_cast<size_t>(status)].Add(ordinal);
+    document_word_freqs_.push_back(move(words_in_doc));
     document_ids_.insert(document_id);
 }
 
@@ -41,16 +107,20 @@ void SearchServer::AddDocument(int document_id, string_view document, DocumentSt
 // Однопоточная версия FindTopDocuments
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
-    // Задаем предикат-лямбду по статусу
-    auto predicate = [status](int document_id, DocumentStatus document_status, int rating) {return document_status == status; };
-
-    return FindTopDocuments(raw_query, predicate);
+    return FindTopDocuments(raw_query, status, SearchOptions{});
 }
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const {
    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, const SearchOptions& options) const {
+    // Предикат по статусу проверяется по битовой карте статуса
+    const StatusPredicate predicate{ status };
+
+    return FindTopDocuments(raw_query, predicate, options);
+}
+
 
 // Многопоточная версия FindTopDocuments с последовательным параметром
 
@@ -59,10 +129,7 @@ std::vector<Document> SearchServer::FindTopDocuments(
     std::string_view raw_query,
     DocumentStatus status) const {
 
-    // Задаем предикат-лямбду по статусу
-    auto predicate = [status](int document_id, DocumentStatus document_status, int rating) {return document_status == status; };
-
-    return FindTopDocuments(raw_query, predicate);
+    return FindTopDocuments(raw_query, status);
 }
 
 
@@ -73,6 +140,15 @@ std::vector<Document> SearchServer::FindTopDocuments(
     return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
+std::vector<Document> SearchServer::FindTopDocuments(
+    const std::execution::sequenced_policy& policy,
+    std::string_view raw_query,
+    DocumentStatus status,
+    const SearchOptions& options) const {
+
+    return FindTopDocuments(raw_query, status, options);
+}
+
 
 // Многопоточная реализация FindTopDocuments с параллельным параметром
 
@@ -81,10 +157,7 @@ std::vector<Document> SearchServer::FindTopDocuments(
     std::string_view raw_query,
     DocumentStatus status) const {
 
-    // Задаем предикат-лямбду по статусу
-    auto predicate = [status](int document_id, DocumentStatus document_status, int rating) {return document_status == status; };
-
-    return FindTopDocuments(policy, raw_query, predicate);
+    return FindTopDocuments(policy, raw_query, status, SearchOptions{});
 }
 
 
@@ -95,30 +168,92 @@ std::vector<Document> SearchServer::FindTopDocuments(
     return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 }
 
-int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+std::vector<Document> SearchServer::FindTopDocuments(
+    const std::execution::parallel_policy& policy,
+    std::string_view raw_query,
+    DocumentStatus status,
+    const SearchOptions& options) const {
+
+    // Предикат по статусу проверяется по битовой карте статуса
+    const StatusPredicate predicate{ status };
+
+    return FindTopDocuments(policy, raw_query, predicate, options);
 }
 
 
-std::set<int>::iterator SearchServer::begin() {
-    return document_ids_.begin();
+// Версии FindTopDocuments для разобранного запроса
+
+vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& query, DocumentStatus status) const {
+    return FindTopDocuments(query, status, SearchOptions{});
 }
 
-std::set<int>::iterator SearchServer::end() {
-    return document_ids_.end();
+vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& query) const {
+    return FindTopDocuments(query, DocumentStatus::ACTUAL);
 }
 
-// Последовательная (однопоточная) версия MatchDocument
-tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_view raw_query, int document_id) const {
-    // Проверка, что id есть в базе
-    if (document_ids_.count(document_id) == 0) {
-        throw std::out_of_range("Document id not found"s);
-    }
+vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& query, DocumentStatus status, const SearchOptions& options) const {
+    // Предикат по статусу проверяется по битовой карте статуса
+    const StatusPredicate predicate{ status };
 
-    // Преобразует строку запроса в формат SearchServer::Query (2xvector<string_view>)
+    return FindTopDocuments(query, predicate, options);
+}
+
+vector<Document> SearchServer::FindTopDocuments(
+    const execution::sequenced_policy& policy,
+    const PreparedQuery& query,
+    DocumentStatus status) const {
+
+    return FindTopDocuments(query, status);
+}
+
+vector<Document> SearchServer::FindTopDocuments(
+    const execution::sequenced_policy& policy,
+    const PreparedQuery& query,
+    DocumentStatus status,
+    const SearchOptions& options) const {
+
+    return FindTopDocuments(query, status, options);
+}
+
+vector<Document> SearchServer::FindTopDocuments(
+    const execution::sequenced_policy& policy,
+    const PreparedQuery& query) const {
+
+    return FindTopDocuments(query, DocumentStatus::ACTUAL);
+}
+
+vector<Document> SearchServer::FindTopDocuments(
+    const execution::parallel_policy& policy,
+    const PreparedQuery& query,
+    DocumentStatus status) const {
+
+    return FindTopDocuments(policy, query, status, SearchOptions{});
+}
+
+vector<Document> SearchServer::FindTopDocuments(
+    const execution::parallel_policy& policy,
+    const PreparedQuery& query,
+    DocumentStatus status,
+    const SearchOptions& options) const {
+
+    // Предикат по статусу проверяется по битовой карте статуса
+    const StatusPredicate predicate{ status };
+
+    return FindTopDocuments(policy, query, predicate, options);
+}
+
+vector<Document> SearchServer::FindTopDocuments(
+    const execution::parallel_policy& policy,
+    const PreparedQuery& query) const {
+
+    return FindTopDocuments(policy, query, DocumentStatus::ACTUAL);
+}
+
+PreparedQuery SearchServer::PrepareQuery(string_view raw_query) const {
+    // Выводит структуру Query (2xvector<string_view>)
     auto query = ParseQuery(raw_query);
 
-    // Сортируем полуенный результат - для Query с list
+    // Сортируем полуенный результат и убираем повторы
     sort(query.plus_words.begin(), query.plus_words.end());
     auto new_end = unique(query.plus_words.begin(), query.plus_words.end());
     query.plus_words.erase(new_end, query.plus_words.end());
@@ -127,36 +262,202 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_vi
     new_end = unique(query.minus_words.begin(), query.minus_words.end());
     query.minus_words.erase(new_end, query.minus_words.end());
 
-    // Контейнер для сбора найденных слов в документе
-    vector<string_view> matched_words;
+    // Копируем слова и запоминаем их номера в словаре этого сервера
+    PreparedQuery prepared_query;
+    prepared_query.dictionary_uid_ = terms_.GetUid();
+    for (const string_view word : query.plus_words) {
+        prepared_query.plus_words_.emplace_back(word);
+        prepared_query.plus_term_ids_.push_back(terms_.FindTerm(word));
+    }
+    for (const string_view word : query.minus_words) {
+        prepared_query.minus_words_.emplace_back(word);
+        prepared_query.minus_term_ids_.push_back(terms_.FindTerm(word));
+    }
 
-    // Поиск в документе минус слов из запроса. Если слово налено - очищаем контейнер и переходим к выводу
-    bool minus_is_not_presented = true;
-    for (auto& word : query.minus_words) {
-        if (word_to_document_freqs_.count(string{ word }) == 0) {
-            continue;
+    return prepared_query;
+}
+
+vector<PreparedQuery> SearchServer::PrepareQueries(
+    const execution::sequenced_policy& policy,
+    const vector<string>& raw_queries) const {
+
+    vector<PreparedQuery> queries;
+    queries.reserve(raw_queries.size());
+    for (const string& raw_query : raw_queries) {
+        queries.push_back(PrepareQuery(raw_query));
+    }
+    return queries;
+}
+
+vector<PreparedQuery> SearchServer::PrepareQueries(
+    const execution::parallel_policy& policy,
+    const vector<string>& raw_queries) const {
+
+    vector<PreparedQuery> queries(raw_queries.size());
+    ForEachIndex(policy, raw_queries.size(), [&](size_t i) {
+        queries[i] = PrepareQuery(raw_queries[i]);
+    });
+    return queries;
+}
+
+vector<size_t> SearchServer::GetDocumentFreqs(const PreparedQuery& query) const {
+    vector<size_t> document_freqs;
+    document_freqs.reserve(query.plus_words_.size());
+    for (const string& word : query.plus_words_) {
+        const int term_id = terms_.FindTerm(word);
+        document_freqs.push_back(term_id == TermDictionary::NO_TERM ? 0 : index_.GetDocumentFreq(term_id));
+    }
+    return document_freqs;
+}
+
+SearchServer::QueryTerms SearchServer::ResolveQuery(const PreparedQuery& query) const {
+    // Номера, запомненные этим же словарем, верны: словарь не переиспользует номера.
+    // Слово, которого не было при подготовке запроса, могло появиться позже
+    const bool is_own_dictionary = query.dictionary_uid_ == terms_.GetUid();
+
+    auto resolve = [&](const vector<string>& words, const vector<int>& term_ids, size_t i) {
+        return is_own_dictionary && term_ids[i] != TermDictionary::NO_TERM
+            ? term_ids[i]
+            : terms_.FindTerm(words[i]);
+    };
+
+    // IDF плюс слов берется из запроса, если он ее задает
+    const bool has_query_statistics = !query.plus_inverse_document_freqs_.empty();
+
+    QueryTerms terms;
+    terms.plus_term_ids.reserve(query.plus_words_.size());
+    terms.plus_inverse_document_freqs.reserve(query.plus_words_.size());
+    for (size_t i = 0; i < query.plus_words_.size(); ++i) {
+        const int term_id = resolve(query.plus_words_, query.plus_term_ids_, i);
+        if (term_id != TermDictionary::NO_TERM) {
+            terms.plus_term_ids.push_back(term_id);
+            terms.plus_inverse_document_freqs.push_back(has_query_statistics
+                ? query.plus_inverse_document_freqs_[i]
+                : index_.GetInverseDocumentFreq(term_id));
         }
-        if (word_to_document_freqs_.at(string{ word }).count(document_id)) {
-            matched_words.clear();
-            minus_is_not_presented = false;
-            break;
+    }
+
+    terms.minus_term_ids.reserve(query.minus_words_.size());
+    for (size_t i = 0; i < query.minus_words_.size(); ++i) {
+        const int term_id = resolve(query.minus_words_, query.minus_term_ids_, i);
+        if (term_id != TermDictionary::NO_TERM) {
+            terms.minus_term_ids.push_back(term_id);
         }
     }
 
-    // Поиск в документе плюс слов из запроса. Если слово найдено - добавляем в контейнер
-    if (minus_is_not_presented) {
-        for (auto& word : query.plus_words) {
-            if (word_to_document_freqs_.count(string{ word }) == 0) {
-                continue;
-            }
-            if (word_to_document_freqs_.at(string{ word }).count(document_id)) {
-                matched_words.push_back(word);
-            }
+    return terms;
+}
+
+SearchServer::QueryPostings SearchServer::GetQueryPostings(const QueryTerms& query) const {
+    QueryPostings postings;
+
+    // Буферы выделяются заранее: списки указывают внутрь них
+    postings.buffers.resize(query.plus_term_ids.size() + 1);
+    auto buffer_it = postings.buffers.begin();
+
+    for (size_t i = 0; i < query.plus_term_ids.size(); ++i) {
+        const auto list = index_.GetPostings(query.plus_term_ids[i], *buffer_it++);
+        if (!list.empty()) {
+            postings.plus_postings.emplace_back(list, query.plus_inverse_document_freqs[i]);
         }
     }
 
-    // Выводим список найденных слов (или пустой список) и статус документа
-    return { matched_words, documents_.at(document_id).status };
+    postings.excluded_documents = GetExcludedDocuments(query, *buffer_it);
+
+    return postings;
+}
+
+DocumentBitmap SearchServer::GetExcludedDocuments(const QueryTerms& query, InvertedIndex::PostingBuffer& buffer) const {
+    DocumentBitmap excluded_documents;
+    for (const int term_id : query.minus_term_ids) {
+        const auto list = index_.GetPostings(term_id, buffer);
+        excluded_documents.AddSorted(list.ordinals, list.size);
+    }
+    return excluded_documents;
+}
+
+vector<pair<int, int>> SearchServer::GetSearchRanges() const {
+    // Несколько диапазонов на поток сглаживают неравномерность списков по номерам
+    const size_t document_count = document_external_ids_.size();
+    const size_t thread_count = thread_pool_ ? thread_pool_->GetThreadCount() : max(1u, thread::hardware_concurrency());
+    const size_t range_count = max<size_t>(1, min(thread_count * 4, document_count / MIN_DOCUMENTS_PER_SEARCH_RANGE));
+
+    vector<pair<int, int>> ranges;
+    ranges.reserve(range_count);
+    for (size_t i = 0; i < range_count; ++i) {
+        ranges.emplace_back(static_cast<int>(document_count * i / range_count),
+            static_cast<int>(document_count * (i + 1) / range_count));
+    }
+    return ranges;
+}
+
+void SearchServer::SetThreadPool(shared_ptr<ThreadPool> thread_pool) {
+    thread_pool_ = move(thread_pool);
+}
+
+const shared_ptr<ThreadPool>& SearchServer::GetThreadPool() const {
+    return thread_pool_;
+}
+
+void SearchServer::SetPostingFormat(PostingFormat format) {
+    index_.SetFormat(format);
+}
+
+PostingFormat SearchServer::GetPostingFormat() const {
+    return index_.GetFormat();
+}
+
+void SearchServer::SetScoreBlockSize(size_t block_size) {
+    index_.SetScoreBlockSize(block_size);
+}
+
+size_t SearchServer::GetScoreBlockSize() const {
+    return index_.GetScoreBlockSize();
+}
+
+void SearchServer::SetCompactionRatio(double ratio) {
+    index_.SetCompactionRatio(ratio);
+}
+
+double SearchServer::GetCompactionRatio() const {
+    return index_.GetCompactionRatio();
+}
+
+void SearchServer::WaitForCompaction() {
+    index_.WaitForCompaction();
+}
+
+size_t SearchServer::GetIndexByteSize() const {
+    return index_.GetPostingsByteSize();
+}
+
+int SearchServer::GetDocumentCount() const {
+    return document_ids_.size();
+}
+
+
+std::set<int>::iterator SearchServer::begin() {
+    return document_ids_.begin();
+}
+
+std::set<int>::iterator SearchServer::end() {
+    return document_ids_.end();
+}
+
+std::set<int>::const_iterator SearchServer::begin() const {
+    return document_ids_.begin();
+}
+
+std::set<int>::const_iterator SearchServer::end() const {
+    return document_ids_.end();
+}
+
+// Последовательная (однопоточная) версия MatchDocument
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_view raw_query, int document_id) const {
+    // Проверка, что id есть в базе до разбора запроса
+    GetOrdinal(document_id);
+
+    return MatchDocument(PrepareQuery(raw_query), document_id);
 }
 
 // Последовательная (задано параметром) версия MatchDocument
@@ -172,92 +473,213 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(
     const execution::parallel_policy& policy,
     string_view raw_query,
     int document_id) const {
-    
+
+    // Проверка, что id есть в базе до разбора запроса
+    GetOrdinal(document_id);
+
+    return MatchDocument(policy, PrepareQuery(raw_query), document_id);
+}
+
+// Последовательная версия MatchDocument для разобранного запроса
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const PreparedQuery& prepared_query, int document_id) const {
     // Проверка, что id есть в базе
-    if (document_ids_.count(document_id) == 0) {
-        throw std::out_of_range("Document id not found"s);
+    const int ordinal = GetOrdinal(document_id);
+
+    // Номера слов запроса в словаре сервера
+    const auto query = ResolveQuery(prepared_query);
+
+    // Контейнер для сбора найденных слов в документе
+    vector<string_view> matched_words;
+
+    // Поиск в документе минус слов из запроса. Если слово найдено - выводим пустой список
+    for (const int term_id : query.minus_term_ids) {
+        if (index_.ContainsDocument(term_id, ordinal)) {
+            return { matched_words, document_statuses_[ordinal] };
+        }
     }
 
-    // Преобразует строку запроса в формат SearchServer::Query (2xvector<string_view>)
-    auto query = ParseQuery(raw_query);
+    // Поиск в документе плюс слов из запроса. Если слово найдено - добавляем в контейнер
+    for (const int term_id : query.plus_term_ids) {
+        if (index_.ContainsDocument(term_id, ordinal)) {
+            matched_words.push_back(terms_.GetWord(term_id));
+        }
+    }
+
+    // Выводим список найденных слов и статус документа
+    return { matched_words, document_statuses_[ordinal] };
+}
+
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(
+    const execution::sequenced_policy& policy,
+    const PreparedQuery& query,
+    int document_id) const {
+    return MatchDocument(query, document_id);
+}
+
+// Параллельная версия MatchDocument для разобранного запроса
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(
+    const execution::parallel_policy& policy,
+    const PreparedQuery& prepared_query,
+    int document_id) const {
+
+    // Проверка, что id есть в базе
+    const int ordinal = GetOrdinal(document_id);
+
+    // Номера слов запроса в словаре сервера
+    const auto query = ResolveQuery(prepared_query);
 
     // Контейнер для сбора и возврата найденных слов в документе
     vector<string_view> matched_words;
 
     // Ссылка на словарь содержащихся в документе слов
-    auto& words_in_document = documents_to_word_freqs_.at(document_id);
+    auto& words_in_document = document_word_freqs_[ordinal];
+
+    // Наличие в документе каждого слова запроса: сначала минус, затем плюс слова.
+    // Проверяется в параллельном режиме
+    const size_t minus_count = query.minus_term_ids.size();
+    vector<char> is_presented(minus_count + query.plus_term_ids.size());
+    ForEachIndex(policy, is_presented.size(), [&](size_t i) {
+        const int term_id = i < minus_count ? query.minus_term_ids[i] : query.plus_term_ids[i - minus_count];
+        is_presented[i] = words_in_document.count(terms_.GetWord(term_id)) > 0;
+    });
+
+    // Если минус слов нет, переносим найденные плюс слова. Слова запроса
+    // уже без повторов и отсортированы, поэтому порядок сохраняется
+    if (none_of(is_presented.begin(), is_presented.begin() + minus_count, [](char presented) { return presented; })) {
+        for (size_t i = 0; i < query.plus_term_ids.size(); ++i) {
+            if (is_presented[minus_count + i]) {
+                matched_words.push_back(terms_.GetWord(query.plus_term_ids[i]));
+            }
+        }
+    }
 
-    // Проверяем наличие стоп-слов в документе в параллельном режиме
-    bool minus_is_presented = any_of(policy,
-        query.minus_words.begin(), query.minus_words.end(),
-        [&](auto& word) {return words_in_document.count(string{ word }); });
+    // Выводим список найденных слов (или пустой список) и статус документа
+    return { matched_words, document_statuses_[ordinal] };
+}
 
-    // Если минус слов нет, переходим к поиску и копированию плюс слов
-    if (!minus_is_presented) {
-        // Меняем размер контейнера - для Query с list
-        matched_words.resize(query.plus_words.size());
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(const vector<PreparedQuery>& queries) const {
+    return FindTopDocumentsBatch(queries, DocumentStatus::ACTUAL, SearchOptions{});
+}
 
-        //Лямбда-функции для работы поиска плюс слов
-        auto is_presented = [&](auto& word) {
-            bool presented = false;
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(
+    const vector<PreparedQuery>& queries,
+    DocumentStatus status,
+    const SearchOptions& options) const {
+    return FindTopDocumentsBatchImpl(execution::seq, queries, status, options);
+}
 
-            if (words_in_document.count(string{ word })) {
-                presented = true;
-            }
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(
+    const execution::sequenced_policy& policy,
+    const vector<PreparedQuery>& queries) const {
+    return FindTopDocumentsBatch(queries);
+}
 
-            return presented;
-        };
-        
-        // Переносим слова в контейнер
-        auto new_end = copy_if(policy,
-            query.plus_words.begin(), query.plus_words.end(),
-            matched_words.begin(),
-            is_presented);
-
-        //Меняем размер контейнера
-        matched_words.erase(new_end, matched_words.end());
-    }
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(
+    const execution::sequenced_policy& policy,
+    const vector<PreparedQuery>& queries,
+    DocumentStatus status,
+    const SearchOptions& options) const {
+    return FindTopDocumentsBatch(queries, status, options);
+}
+
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(
+    const execution::parallel_policy& policy,
+    const vector<PreparedQuery>& queries) const {
+    return FindTopDocumentsBatch(policy, queries, DocumentStatus::ACTUAL, SearchOptions{});
+}
 
-    // Приводим вектор слов к нужному виду
-    sort(policy, matched_words.begin(), matched_words.end());
-    auto last = unique(policy, matched_words.begin(), matched_words.end());
-    matched_words.erase(last, matched_words.end());
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(
+    const execution::parallel_policy& policy,
+    const vector<PreparedQuery>& queries,
+    DocumentStatus status,
+    const SearchOptions& options) const {
+    return FindTopDocumentsBatchImpl(policy, queries, status, options);
+}
 
-    // Выводим список найденных слов (или пустой список) и статус документа
-    return { matched_words, documents_.at(document_id).status };
+DocumentMatches SearchServer::MatchDocuments(string_view raw_query, const vector<int>& document_ids) const {
+    return MatchDocuments(PrepareQuery(raw_query), document_ids);
+}
+
+DocumentMatches SearchServer::MatchDocuments(
+    const execution::sequenced_policy& policy,
+    string_view raw_query,
+    const vector<int>& document_ids) const {
+    return MatchDocuments(PrepareQuery(raw_query), document_ids);
+}
+
+DocumentMatches SearchServer::MatchDocuments(
+    const execution::parallel_policy& policy,
+    string_view raw_query,
+    const vector<int>& document_ids) const {
+    return MatchDocuments(policy, PrepareQuery(raw_query), document_ids);
+}
+
+DocumentMatches SearchServer::MatchDocuments(const PreparedQuery& query, const vector<int>& document_ids) const {
+    return MatchDocumentsImpl(execution::seq, query, document_ids);
+}
+
+DocumentMatches SearchServer::MatchDocuments(
+    const execution::sequenced_policy& policy,
+    const PreparedQuery& query,
+    const vector<int>& document_ids) const {
+    return MatchDocumentsImpl(policy, query, document_ids);
+}
+
+DocumentMatches SearchServer::MatchDocuments(
+    const execution::parallel_policy& policy,
+    const PreparedQuery& query,
+    const vector<int>& document_ids) const {
+    return MatchDocumentsImpl(policy, query, document_ids);
 }
 
 const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
     //Пустой словарь для выполения условия задания по возвращению ссылки на пустой map
-    static map<string_view, double> response_;
-    response_.clear();
+    static const map<string_view, double> empty_response;
 
     // Если документа нет, то вощвращаем пустой контейнер
-    if (documents_to_word_freqs_.count(document_id) == 0) {
-        return response_;
+    auto it = document_id_to_ordinal_.find(document_id);
+    if (it == document_id_to_ordinal_.end()) {
+        return empty_response;
     }
 
+    return document_word_freqs_[it->second];
+}
 
-    for (auto& word_freq : documents_to_word_freqs_.at(document_id)) {
-        string_view word_view = word_freq.first;
-        response_.insert({ word_view, word_freq.second });
+vector<int> SearchServer::GetDocumentTermIds(int document_id) const {
+    auto it = document_id_to_ordinal_.find(document_id);
+    if (it == document_id_to_ordinal_.end()) {
+        return {};
     }
 
-    return response_;
+    const auto& word_freqs = document_word_freqs_[it->second];
+    vector<int> term_ids;
+    term_ids.reserve(word_freqs.size());
+    for (const auto& [word, freq] : word_freqs) {
+        term_ids.push_back(terms_.FindTerm(word));
+    }
+    return term_ids;
 }
 
 void SearchServer::RemoveDocument(int document_id) {
-    if(document_ids_.count(document_id) == 0){
+    auto it = document_id_to_ordinal_.find(document_id);
+    if (it == document_id_to_ordinal_.end()) {
         return;
     }
-
-    for (auto& [word, freq] : documents_to_word_freqs_.at(document_id)) {
-        word_to_document_freqs_.at(word).erase(document_id);
+    const int ordinal = it->second;
+
+    // Документ помечается удаленным, списки слов переписывает фоновое уплотнение.
+    // Его ordinal больше не используется, освобождаем только словарь слов
+    vector<int> term_ids;
+    term_ids.reserve(document_word_freqs_[ordinal].size());
+    for (const auto& [word, freq] : document_word_freqs_[ordinal]) {
+        term_ids.push_back(terms_.FindTerm(word));
     }
+    index_.RemoveDocument(ordinal, term_ids);
+    document_word_freqs_[ordinal].clear();
+    status_documents_[static_cast<size_t>(document_statuses_[ordinal])].Remove(ordinal);
 
+    document_id_to_ordinal_.erase(it);
     document_ids_.erase(document_id);
-    documents_.erase(document_id);
-    documents_to_word_freqs_.erase(document_id);
 }
 
 // Многопоточная версия с однопоточным параметом
@@ -265,39 +687,35 @@ void SearchServer::RemoveDocument(const std::execution::sequenced_policy& policy
     RemoveDocument(document_id);
 }
 
-// Многопоточная версия с многопоточным параметром
+// Многопоточная версия с многопоточным параметром.
+// Удаление из индекса сводится к пометке документа удаленным, поэтому
+// распараллеливать по словам документа больше нечего
 void SearchServer::RemoveDocument(const std::execution::parallel_policy& policy, int document_id) {
-    if (document_ids_.count(document_id) == 0) {
-        return;
-    }
-
-    // Вытаскиваем словарь для document_id
-    auto& words_frequency = documents_to_word_freqs_.at(document_id);
-
-    // Создаем вектор для хранения указателей на слова в документе
-    vector<const string*> words(words_frequency.size());
-
-    // Преобразуем изъятый словарь в вектор слов документа document_id
-    transform(policy,
-        words_frequency.begin(), words_frequency.end(),
-        words.begin(),
-        [](pair<const string, double>& word_freq) {return &word_freq.first; });
+    RemoveDocument(document_id);
+}
 
-    // Функция для удаления номера документа у слова
-    auto erase_id = [&](auto& word) { word_to_document_freqs_.at(*word).erase(document_id); };
+void SearchServer::RemoveDocuments(const vector<int>& document_ids) {
+    RemoveDocumentsImpl(execution::seq, document_ids);
+}
 
-    // Удаление документов из слов
-    for_each(policy,
-        words.begin(), words.end(),
-        erase_id);
+void SearchServer::RemoveDocuments(const execution::sequenced_policy& policy, const vector<int>& document_ids) {
+    RemoveDocumentsImpl(policy, document_ids);
+}
 
-    document_ids_.erase(document_id);
-    documents_.erase(document_id);
-    documents_to_word_freqs_.erase(document_id);
+void SearchServer::RemoveDocuments(const execution::parallel_policy& policy, const vector<int>& document_ids) {
+    RemoveDocumentsImpl(policy, document_ids);
 }
 
 //private
 
+int SearchServer::GetOrdinal(int document_id) const {
+    auto it = document_id_to_ordinal_.find(document_id);
+    if (it == document_id_to_ordinal_.end()) {
+        throw std::out_of_range("Document id not found"s);
+    }
+    return it->second;
+}
+
 bool SearchServer::IsStopWord(string_view word) const {
     return stop_words_.find(word) == stop_words_.end() ? 0 : 1;
 }
@@ -374,11 +792,4 @@ SearchServer::Query SearchServer::ParseQuery(string_view text) const {
     }
 
     return result;
-}
-
-// Existence required
-double SearchServer::ComputeWordInverseDocumentFreq(const string& word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
-}
-
-
+}
\ No newline at end of file
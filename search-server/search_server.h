@@ -2,22 +2,86 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <memory>
+#include <numeric>
 #include <set>
 #include <algorithm>
+#include <array>
 #include <execution>
+#include <exception>
 #include <functional>
+#include <limits>
+#include <stdexcept>
 #include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
+#include <tuple>
 #include <type_traits>
 
 
 #include "document.h"
+#include "document_bitmap.h"
 #include "string_processing.h"
-#include "concurrent_map.h"
+#include "inverted_index.h"
+#include "posting_cursor.h"
+#include "prepared_query.h"
+#include "score_accumulator.h"
+#include "term_dictionary.h"
+#include "thread_pool.h"
+#include "top_documents.h"
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
-const double RELEVANCE_COMPARE_ACCURACY = 1e-6;
-const size_t MAX_BUCKETS_DURING_SEARCH = 128;
+
+// Наименьшее количество документов в диапазоне при параллельном поиске
+const size_t MIN_DOCUMENTS_PER_SEARCH_RANGE = 2048;
+
+// Способ вычисления выдачи
+enum class EvaluationMode {
+    // Полный перебор: релевантность считается для всех документов со словами запроса
+    EXHAUSTIVE,
+    // MaxScore: обход документ-за-документом с пропуском документов, которые
+    // по верхней оценке релевантности не могут попасть в выдачу
+    MAX_SCORE,
+    // MaxScore с оценками по блокам списков: целиком пропускаются участки
+    // списков, блоки которых не могут дать документа для выдачи
+    BLOCK_MAX_SCORE,
+};
+
+// Параметры поискового запроса
+struct SearchOptions {
+    // Максимальное количество документов в выдаче
+    size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT;
+    // Способ вычисления. Параллельные версии всегда используют полный перебор
+    EvaluationMode evaluation = EvaluationMode::EXHAUSTIVE;
+};
+
+// Результат MatchDocuments. Найденные слова всех документов хранятся номерами
+// в общей таблице слов: слова i-го документа - words[word_indices[k]]
+// для k из [offsets[i], offsets[i + 1]), по возрастанию
+struct DocumentMatches {
+    // Плюс слова запроса, известные серверу, по возрастанию
+    std::vector<std::string_view> words;
+    std::vector<size_t> offsets;
+    std::vector<uint32_t> word_indices;
+    // Статус i-го документа
+    std::vector<DocumentStatus> statuses;
+
+    size_t GetDocumentCount() const {
+        return statuses.size();
+    }
+
+    // Найденные слова i-го документа
+    std::vector<std::string_view> GetWords(size_t index) const {
+        std::vector<std::string_view> result;
+        result.reserve(offsets[index + 1] - offsets[index]);
+        for (size_t i = offsets[index]; i < offsets[index + 1]; ++i) {
+            result.push_back(words[word_indices[i]]);
+        }
+        return result;
+    }
+};
 
 class SearchServer {
 public:
@@ -35,8 +99,30 @@ public:
     // Добавление документа на сервер
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
+    // Пакетное добавление документов. Тексты разбираются параллельно (для
+    // parallel_policy) в частичные индексы частей пакета, затем вхождения всех
+    // документов инвертируются одной сортировкой по (слово, документ) и вливаются
+    // в индекс за одно слияние. Результат тот же, что у AddDocument по порядку.
+    // Бросает invalid_argument, не меняя сервер, если номер документа недопустим
+    // или повторяется либо текст содержит недопустимое слово
+    void AddDocuments(const std::vector<DocumentInput>& documents);
+    void AddDocuments(const std::execution::sequenced_policy& policy, const std::vector<DocumentInput>& documents);
+    void AddDocuments(const std::execution::parallel_policy& policy, const std::vector<DocumentInput>& documents);
+
+    // Перенос действующих документов другого сервера без повторного разбора
+    // текстов: слова, частоты, рейтинги и статусы сохраняются точно. Бросает
+    // invalid_argument, если номер документа уже есть в сервере
+    void MergeFrom(const SearchServer& source);
+
+    // Перенос без документов с номерами из skipped_ids
+    void MergeFrom(const SearchServer& source, const std::unordered_set<int>& skipped_ids);
 
-    // Поиск и вывод первых MAX_RESULT_DOCUMENT_COUNT наиболее релевантных документов 
+    // Есть ли документ в сервере
+    bool HasDocument(int document_id) const;
+
+
+    // Поиск и вывод первых MAX_RESULT_DOCUMENT_COUNT наиболее релевантных документов.
+    // Версии с SearchOptions позволяют задать размер выдачи для каждого запроса
 
     // Однопоточная версия FindTopDocuments
     template <typename DocumentPredicate>
@@ -44,6 +130,17 @@ public:
     std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
     std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
 
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(
+        std::string_view raw_query,
+        DocumentPredicate document_predicate,
+        const SearchOptions& options) const;
+
+    std::vector<Document> FindTopDocuments(
+        std::string_view raw_query,
+        DocumentStatus status,
+        const SearchOptions& options) const;
+
     // Многопоточная версия FindTopDocuments с последовательным параметром
     template <typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(
@@ -56,6 +153,19 @@ public:
         std::string_view raw_query,
         DocumentStatus status) const;
 
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(
+        const std::execution::sequenced_policy& policy,
+        std::string_view raw_query,
+        DocumentPredicate document_predicate,
+        const SearchOptions& options) const;
+
+    std::vector<Document> FindTopDocuments(
+        const std::execution::sequenced_policy& policy,
+        std::string_view raw_query,
+        DocumentStatus status,
+        const SearchOptions& options) const;
+
     std::vector<Document> FindTopDocuments(
         const std::execution::sequenced_policy& policy,
         std::string_view raw_query) const;
@@ -74,11 +184,175 @@ public:
         std::string_view raw_query,
         DocumentStatus status) const;
 
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(
+        const std::execution::parallel_policy& policy,
+        std::string_view raw_query,
+        DocumentPredicate document_predicate,
+        const SearchOptions& options) const;
+
+    std::vector<Document> FindTopDocuments(
+        const std::execution::parallel_policy& policy,
+        std::string_view raw_query,
+        DocumentStatus status,
+        const SearchOptions& options) const;
+
     std::vector<Document> FindTopDocuments(
         const std::execution::parallel_policy& policy,
         std::string_view raw_query) const;
 
 
+    // Пул потоков для версий с parallel_policy. Без пула (по умолчанию)
+    // используется std::execution::par. Копии сервера разделяют один пул
+    void SetThreadPool(std::shared_ptr<ThreadPool> thread_pool);
+    const std::shared_ptr<ThreadPool>& GetThreadPool() const;
+
+
+    // Разбор запроса для многократного использования. Бросает invalid_argument
+    // при недопустимом слове запроса так же, как поиск по строке
+    PreparedQuery PrepareQuery(std::string_view raw_query) const;
+
+    // Разбор набора запросов, параллельный для parallel_policy
+    std::vector<PreparedQuery> PrepareQueries(
+        const std::execution::sequenced_policy& policy,
+        const std::vector<std::string>& raw_queries) const;
+
+    std::vector<PreparedQuery> PrepareQueries(
+        const std::execution::parallel_policy& policy,
+        const std::vector<std::string>& raw_queries) const;
+
+    // Количество документов сервера, содержащих каждое плюс слово запроса,
+    // в порядке PreparedQuery::GetPlusWords(). Вместе с GetDocumentCount()
+    // позволяет посчитать общую статистику нескольких серверов
+    std::vector<size_t> GetDocumentFreqs(const PreparedQuery& query) const;
+
+    // Версии FindTopDocuments для заранее разобранного запроса
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const PreparedQuery& query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const PreparedQuery& query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const PreparedQuery& query) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(
+        const PreparedQuery& query,
+        DocumentPredicate document_predicate,
+        const SearchOptions& options) const;
+
+    std::vector<Document> FindTopDocuments(
+        const PreparedQuery& query,
+        DocumentStatus status,
+        const SearchOptions& options) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(
+        const std::execution::sequenced_policy& policy,
+        const PreparedQuery& query,
+        DocumentPredicate document_predicate) const;
+
+    std::vector<Document> FindTopDocuments(
+        const std::execution::sequenced_policy& policy,
+        const PreparedQuery& query,
+        DocumentStatus status) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(
+        const std::execution::sequenced_policy& policy,
+        const PreparedQuery& query,
+        DocumentPredicate document_predicate,
+        const SearchOptions& options) const;
+
+    std::vector<Document> FindTopDocuments(
+        const std::execution::sequenced_policy& policy,
+        const PreparedQuery& query,
+        DocumentStatus status,
+        const SearchOptions& options) const;
+
+    std::vector<Document> FindTopDocuments(
+        const std::execution::sequenced_policy& policy,
+        const PreparedQuery& query) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(
+        const std::execution::parallel_policy& policy,
+        const PreparedQuery& query,
+        DocumentPredicate document_predicate) const;
+
+    std::vector<Document> FindTopDocuments(
+        const std::execution::parallel_policy& policy,
+        const PreparedQuery& query,
+        DocumentStatus status) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(
+        const std::execution::parallel_policy& policy,
+        const PreparedQuery& query,
+        DocumentPredicate document_predicate,
+        const SearchOptions& options) const;
+
+    std::vector<Document> FindTopDocuments(
+        const std::execution::parallel_policy& policy,
+        const PreparedQuery& query,
+        DocumentStatus status,
+        const SearchOptions& options) const;
+
+    std::vector<Document> FindTopDocuments(
+        const std::execution::parallel_policy& policy,
+        const PreparedQuery& query) const;
+
+
+    // Пакетный поиск: i-я выдача совпадает с FindTopDocuments(queries[i], status, options).
+    // Слова всех запросов пакета находятся в индексе один раз. Запросы с общими
+    // словами вычисляются группами, и список слова проходится один раз для всей
+    // группы, пока он в кэше. Всегда используется полный перебор
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<PreparedQuery>& queries) const;
+
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(
+        const std::vector<PreparedQuery>& queries,
+        DocumentStatus status,
+        const SearchOptions& options) const;
+
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(
+        const std::execution::sequenced_policy& policy,
+        const std::vector<PreparedQuery>& queries) const;
+
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(
+        const std::execution::sequenced_policy& policy,
+        const std::vector<PreparedQuery>& queries,
+        DocumentStatus status,
+        const SearchOptions& options) const;
+
+    // Параллельная версия: группы запросов вычисляются параллельно
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(
+        const std::execution::parallel_policy& policy,
+        const std::vector<PreparedQuery>& queries) const;
+
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(
+        const std::execution::parallel_policy& policy,
+        const std::vector<PreparedQuery>& queries,
+        DocumentStatus status,
+        const SearchOptions& options) const;
+
+
+    // Формат хранения списков документов в индексе (RAW по умолчанию).
+    // Индекс перекодируется при следующем поисковом запросе
+    void SetPostingFormat(PostingFormat format);
+    PostingFormat GetPostingFormat() const;
+
+    // Размер блока списков, для которого хранится оценка вклада слова (BLOCK_MAX_SCORE)
+    void SetScoreBlockSize(size_t block_size);
+    size_t GetScoreBlockSize() const;
+
+    // Доля удаленных через RemoveDocument документов, после которой списки
+    // уплотняются в фоновом потоке (DEFAULT_COMPACTION_RATIO по умолчанию)
+    void SetCompactionRatio(double ratio);
+    double GetCompactionRatio() const;
+
+    // Ожидание фонового уплотнения списков
+    void WaitForCompaction();
+
+    // Объем памяти, занимаемый списками документов индекса, в байтах
+    size_t GetIndexByteSize() const;
+
     // Вывод количества документов в базе
     int GetDocumentCount() const;
 
@@ -86,6 +360,8 @@ public:
     //int GetDocumentId(int index) const;
     std::set<int>::iterator begin();
     std::set<int>::iterator end();
+    std::set<int>::const_iterator begin() const;
+    std::set<int>::const_iterator end() const;
 
     // Последовательная (однопоточная) версия MatchDocument
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
@@ -102,9 +378,60 @@ public:
         std::string_view raw_query,
         int document_id) const;
 
+    // Версии MatchDocument для заранее разобранного запроса. Найденные слова
+    // указывают на строки словаря сервера, а не запроса
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const PreparedQuery& query, int document_id) const;
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(
+        const std::execution::sequenced_policy& policy,
+        const PreparedQuery& query,
+        int document_id) const;
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(
+        const std::execution::parallel_policy& policy,
+        const PreparedQuery& query,
+        int document_id) const;
+
+    // Проверка запроса по набору документов: запрос разбирается один раз, список
+    // каждого слова запроса проходится один раз для всех документов. i-й документ
+    // результата соответствует document_ids[i], повторы номеров допускаются.
+    // Бросает out_of_range, если какого-либо документа нет
+    DocumentMatches MatchDocuments(std::string_view raw_query, const std::vector<int>& document_ids) const;
+
+    DocumentMatches MatchDocuments(
+        const std::execution::sequenced_policy& policy,
+        std::string_view raw_query,
+        const std::vector<int>& document_ids) const;
+
+    // Параллельная версия: списки слов запроса проходятся параллельно
+    DocumentMatches MatchDocuments(
+        const std::execution::parallel_policy& policy,
+        std::string_view raw_query,
+        const std::vector<int>& document_ids) const;
+
+    DocumentMatches MatchDocuments(const PreparedQuery& query, const std::vector<int>& document_ids) const;
+
+    DocumentMatches MatchDocuments(
+        const std::execution::sequenced_policy& policy,
+        const PreparedQuery& query,
+        const std::vector<int>& document_ids) const;
+
+    DocumentMatches MatchDocuments(
+        const std::execution::parallel_policy& policy,
+        const PreparedQuery& query,
+        const std::vector<int>& document_ids) const;
+
     // Вывод слов с частотой для документа
     const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
 
+    // Номера слов документа в словаре сервера, в порядке возрастания слов.
+    // Одинаковые наборы слов дают одинаковые списки. Для отсутствующего
+    // документа список пустой
+    std::vector<int> GetDocumentTermIds(int document_id) const;
+
+    // Удаление документа: документ помечается удаленным в индексе и сразу
+    // перестает находиться и учитываться в IDF, а списки слов не переписываются
+    // (см. InvertedIndex::RemoveDocument)
     void RemoveDocument(int document_id);
 
     // Многопоточная версия с однопоточным параметом
@@ -113,14 +440,18 @@ public:
     // Многопоточная версия с многопоточным параметом
     void RemoveDocument(const std::execution::parallel_policy& policy, int document_id);
 
+    // Пакетное удаление документов. Удаления группируются по словам, и список
+    // каждого затронутого слова переписывается один раз за весь пакет, а не
+    // на каждый документ; списки остальных слов не перекодируются. Для
+    // parallel_policy списки переписываются параллельно по диапазонам слов.
+    // Отсутствующие и повторные номера пропускаются
+    void RemoveDocuments(const std::vector<int>& document_ids);
+    void RemoveDocuments(const std::execution::sequenced_policy& policy, const std::vector<int>& document_ids);
+    void RemoveDocuments(const std::execution::parallel_policy& policy, const std::vector<int>& document_ids);
+
 
 private:
     // --- structs ---
-    struct DocumentData {
-        int rating;
-        DocumentStatus status;
-    };
-
     struct QueryWord {
         std::string_view data;
         bool is_minus;
@@ -133,27 +464,78 @@ private:
         std::vector<std::string_view> minus_words;
     };
 
+    // Номера слов запроса в словаре сервера. Плюс слова идут в порядке
+    // PreparedQuery, слова, которых нет в словаре, пропущены
+    struct QueryTerms {
+        std::vector<int> plus_term_ids;
+        std::vector<int> minus_term_ids;
+        // IDF плюс слов: из запроса, если он их задает, иначе из индекса
+        std::vector<double> plus_inverse_document_freqs;
+    };
+
     // --- variables ---
 
     // Список стоп-слов. Добавлен параметр less<> для работы со string_view
     const std::set<std::string, std::less<>> stop_words_;
-    
-    // Словарь слов: слово, (номер документа, частота слова в документе)
-    std::map<std::string, std::map<int, double>> word_to_document_freqs_;
 
-    // Словарь документов: номер документа, (слово, частота слова в документе)
-    std::map<int, std::map<std::string, double>> documents_to_word_freqs_;
-    
-    //Словарь документов: номер документа св-ва
-    std::map<int, DocumentData> documents_;
+    // Словарь слов: слово <-> плотный номер слова (term id)
+    TermDictionary terms_;
+
+    // Инвертированный индекс: term id -> (внутренние номера документов, частоты слова в документах)
+    InvertedIndex index_;
+
+    // Внешний номер документа -> внутренний плотный номер (ordinal). Ordinal выдается
+    // по порядку добавления и не переиспользуется после удаления документа
+    std::unordered_map<int, int> document_id_to_ordinal_;
+
+    // Колонки свойств документов, индексируемые по ordinal
+    std::vector<int> document_external_ids_;
+    std::vector<int> document_ratings_;
+    std::vector<DocumentStatus> document_statuses_;
+
+    // Действующие документы каждого статуса, индекс - значение DocumentStatus
+    static const size_t DOCUMENT_STATUS_COUNT = 4;
+    std::array<DocumentBitmap, DOCUMENT_STATUS_COUNT> status_documents_;
+
+    // Колонка словарей документа: (слово, частота слова в документе).
+    // Слова указывают на строки, хранящиеся в terms_
+    std::vector<std::map<std::string_view, double>> document_word_freqs_;
     
     // Сортированный список документов. Указывается при добавлении документа
     // (в прошлом был vector и указывал порядок добавления)
     std::set<int> document_ids_;
 
+    // Пул потоков параллельных версий или nullptr для std::execution::par
+    std::shared_ptr<ThreadPool> thread_pool_;
+
 
     // --- methods ---
 
+    // Предикат "документ имеет статус status". Поиск распознает его на этапе
+    // компиляции и проверяет статус по битовой карте, не вызывая предикат
+    struct StatusPredicate {
+        DocumentStatus status;
+
+        bool operator()(int document_id, DocumentStatus document_status, int rating) const {
+            return document_status == status;
+        }
+    };
+
+    // Вызов func(i) для i из [0, count). Для parallel_policy - параллельно на пуле
+    // потоков сервера или, если пул не задан, через std::execution::par
+    template <typename ExecutionPolicy, typename Func>
+    void ForEachIndex(ExecutionPolicy&& policy, size_t count, Func func) const;
+
+    // Проверка документа предикатом поиска
+    template <typename DocumentPredicate>
+    bool IsAccepted(const DocumentPredicate& document_predicate, int ordinal) const;
+
+    // Внутренний номер документа. Бросает out_of_range, если документа нет
+    int GetOrdinal(int document_id) const;
+
+    // Добавление документа по готовым количествам вхождений слов (term id в terms_)
+    void AddDocumentTerms(int document_id, DocumentStatus status, int rating, int word_count, const std::map<int, int>& term_counts);
+
     bool IsStopWord(std::string_view word) const;
     static bool IsValidWord(std::string_view word);
 
@@ -166,26 +548,86 @@ private:
     // Последовательный парсинг
     Query ParseQuery(std::string_view text) const;
 
-    // Existence required
-    double ComputeWordInverseDocumentFreq(const std::string& word) const;
+    // Номера слов разобранного запроса в словаре этого сервера
+    QueryTerms ResolveQuery(const PreparedQuery& query) const;
 
     // Однопоточная версия FindAllDocuments
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(Query& query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindAllDocuments(const QueryTerms& query, DocumentPredicate document_predicate) const;
+
+    // Отбор max_count лучших документов алгоритмом MaxScore, при use_block_max -
+    // с оценками по блокам. Выдача совпадает с полным перебором FindAllDocuments + SelectTopDocuments
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsMaxScore(
+        const QueryTerms& query,
+        DocumentPredicate document_predicate,
+        size_t max_count,
+        bool use_block_max) const;
 
     // Многопоточная версия FindAllDocuments с последовательным параметром
     template <typename DocumentPredicate>
     std::vector<Document> FindAllDocuments(
         const std::execution::sequenced_policy& policy,
-        Query& query,
+        const QueryTerms& query,
         DocumentPredicate document_predicate) const;
 
     // Многопоточная версия FindAllDocuments
     template <typename DocumentPredicate>
     std::vector<Document> FindAllDocuments(
         const std::execution::parallel_policy& policy,
-        Query& query,
+        const QueryTerms& query,
         DocumentPredicate document_predicate) const;
+
+    // Списки документов слов запроса, распакованные один раз для всех диапазонов
+    struct QueryPostings {
+        // Список документов плюс слова и его IDF
+        std::vector<std::pair<InvertedIndex::PostingList, double>> plus_postings;
+        // Документы, содержащие минус слова
+        DocumentBitmap excluded_documents;
+        // Буферы распаковки сжатых списков, на которые указывают списки выше
+        std::vector<InvertedIndex::PostingBuffer> buffers;
+    };
+
+    QueryPostings GetQueryPostings(const QueryTerms& query) const;
+
+    // Объединение списков документов минус слов запроса
+    DocumentBitmap GetExcludedDocuments(const QueryTerms& query, InvertedIndex::PostingBuffer& buffer) const;
+
+    // Общая часть последовательной и параллельной версий FindTopDocumentsBatch
+    template <typename ExecutionPolicy>
+    std::vector<std::vector<Document>> FindTopDocumentsBatchImpl(
+        ExecutionPolicy&& policy,
+        const std::vector<PreparedQuery>& prepared_queries,
+        DocumentStatus status,
+        const SearchOptions& options) const;
+
+    // Общая часть последовательной и параллельной версий AddDocuments
+    template <typename ExecutionPolicy>
+    void AddDocumentsImpl(ExecutionPolicy&& policy, const std::vector<DocumentInput>& documents);
+
+    // Общая часть последовательной и параллельной версий RemoveDocuments
+    template <typename ExecutionPolicy>
+    void RemoveDocumentsImpl(ExecutionPolicy&& policy, const std::vector<int>& document_ids);
+
+    // Общая часть последовательной и параллельной версий MatchDocuments
+    template <typename ExecutionPolicy>
+    DocumentMatches MatchDocumentsImpl(
+        ExecutionPolicy&& policy,
+        const PreparedQuery& prepared_query,
+        const std::vector<int>& document_ids) const;
+
+    // Разбиение внутренних номеров документов на диапазоны [begin, end) для параллельного поиска
+    std::vector<std::pair<int, int>> GetSearchRanges() const;
+
+    // Подсчет релевантности документов из диапазона [begin, end) в накопителе потока.
+    // Найденные документы передаются в consumer по возрастанию номера
+    template <typename DocumentPredicate, typename DocumentConsumer>
+    void ScoreDocumentRange(
+        const QueryPostings& postings,
+        DocumentPredicate document_predicate,
+        int begin,
+        int end,
+        DocumentConsumer consumer) const;
 };
 
 
@@ -205,36 +647,40 @@ SearchServer::SearchServer(const StringContainer& stop_words)
 // Однопоточная версия FindTopDocuments
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const {
-    
-    // Выводит структуру Query (2xvector<string_view>)
-    auto query = ParseQuery(raw_query);
+    return FindTopDocuments(raw_query, document_predicate, SearchOptions{});
+}
 
-    // Сортируем полуенный результат - для Query с list
-    std::sort(query.plus_words.begin(), query.plus_words.end());
-    auto new_end = std::unique(query.plus_words.begin(), query.plus_words.end());
-    query.plus_words.erase(new_end, query.plus_words.end());
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(
+    std::string_view raw_query,
+    DocumentPredicate document_predicate,
+    const SearchOptions& options) const {
+    return FindTopDocuments(PrepareQuery(raw_query), document_predicate, options);
+}
 
-    std::sort(query.minus_words.begin(), query.minus_words.end());
-    new_end = std::unique(query.minus_words.begin(), query.minus_words.end());
-    query.minus_words.erase(new_end, query.minus_words.end());
 
-    // Находим все подходящеие документы
-    auto matched_documents = FindAllDocuments(query, document_predicate);
+// Однопоточная версия FindTopDocuments для разобранного запроса
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& prepared_query, DocumentPredicate document_predicate) const {
+    return FindTopDocuments(prepared_query, document_predicate, SearchOptions{});
+}
 
-    sort(matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < RELEVANCE_COMPARE_ACCURACY) {
-                return lhs.rating > rhs.rating;
-            }
-            else {
-                return lhs.relevance > rhs.relevance;
-            }
-        });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(
+    const PreparedQuery& prepared_query,
+    DocumentPredicate document_predicate,
+    const SearchOptions& options) const {
+
+    // Номера слов запроса в словаре сервера
+    const auto query = ResolveQuery(prepared_query);
+
+    if (options.evaluation != EvaluationMode::EXHAUSTIVE) {
+        return FindTopDocumentsMaxScore(query, document_predicate, options.max_result_count,
+            options.evaluation == EvaluationMode::BLOCK_MAX_SCORE);
     }
 
-    return matched_documents;
+    // Находим все подходящеие документы и отбираем из них лучшие
+    return SelectTopDocuments(FindAllDocuments(query, document_predicate), options.max_result_count);
 }
 
 
@@ -247,6 +693,32 @@ std::vector<Document> SearchServer::FindTopDocuments(
     return FindTopDocuments(raw_query, document_predicate);
 }
 
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(
+    const std::execution::sequenced_policy& policy,
+    std::string_view raw_query,
+    DocumentPredicate document_predicate,
+    const SearchOptions& options) const {
+    return FindTopDocuments(raw_query, document_predicate, options);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(
+    const std::execution::sequenced_policy& policy,
+    const PreparedQuery& query,
+    DocumentPredicate document_predicate) const {
+    return FindTopDocuments(query, document_predicate);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(
+    const std::execution::sequenced_policy& policy,
+    const PreparedQuery& query,
+    DocumentPredicate document_predicate,
+    const SearchOptions& options) const {
+    return FindTopDocuments(query, document_predicate, options);
+}
+
 
 // Многопоточная реализация FindTopDocuments с параллельным параметром
 template <typename DocumentPredicate>
@@ -254,36 +726,54 @@ std::vector<Document> SearchServer::FindTopDocuments(
     const std::execution::parallel_policy& policy,
     std::string_view raw_query,
     DocumentPredicate document_predicate) const {
+    return FindTopDocuments(policy, raw_query, document_predicate, SearchOptions{});
+}
 
-    // Выводит структуру Query (2xvector<string_view>)
-    auto query = ParseQuery(raw_query);
-
-    // Сортируем полуенный результат - для Query с list
-    std::sort(query.plus_words.begin(), query.plus_words.end());
-    auto new_end = std::unique(query.plus_words.begin(), query.plus_words.end());
-    query.plus_words.erase(new_end, query.plus_words.end());
-
-    std::sort(query.minus_words.begin(), query.minus_words.end());
-    new_end = std::unique(query.minus_words.begin(), query.minus_words.end());
-    query.minus_words.erase(new_end, query.minus_words.end());
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(
+    const std::execution::parallel_policy& policy,
+    std::string_view raw_query,
+    DocumentPredicate document_predicate,
+    const SearchOptions& options) const {
+    return FindTopDocuments(policy, PrepareQuery(raw_query), document_predicate, options);
+}
 
-    // Находим все подходящеие документы
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(
+    const std::execution::parallel_policy& policy,
+    const PreparedQuery& prepared_query,
+    DocumentPredicate document_predicate) const {
+    return FindTopDocuments(policy, prepared_query, document_predicate, SearchOptions{});
+}
 
-    sort(matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < RELEVANCE_COMPARE_ACCURACY) {
-                return lhs.rating > rhs.rating;
-            }
-            else {
-                return lhs.relevance > rhs.relevance;
-            }
-        });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(
+    const std::execution::parallel_policy& policy,
+    const PreparedQuery& prepared_query,
+    DocumentPredicate document_predicate,
+    const SearchOptions& options) const {
+
+    // Номера слов запроса в словаре сервера
+    const auto query = ResolveQuery(prepared_query);
+
+    // Каждый диапазон документов отбирает свои лучшие документы без блокировок,
+    // затем из них отбираются лучшие по всему серверу
+    const auto postings = GetQueryPostings(query);
+    const auto ranges = GetSearchRanges();
+    std::vector<std::vector<Document>> range_top_documents(ranges.size());
+
+    ForEachIndex(policy, ranges.size(), [&](size_t i) {
+        TopDocuments top(options.max_result_count);
+        ScoreDocumentRange(postings, document_predicate, ranges[i].first, ranges[i].second,
+            [&top](const Document& document) { top.Add(document); });
+        range_top_documents[i] = top.Extract();
+    });
+
+    std::vector<Document> candidates;
+    for (const auto& documents : range_top_documents) {
+        candidates.insert(candidates.end(), documents.begin(), documents.end());
     }
-
-    return matched_documents;
+    return SelectTopDocuments(candidates, options.max_result_count);
 }
 
 
@@ -292,69 +782,228 @@ std::vector<Document> SearchServer::FindTopDocuments(
 
 // Однопоточная версия FindAllDocuments
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(Query& query, DocumentPredicate document_predicate) const {
-    // Контейнер для хранения найденных документов
-    std::map<int, double> document_to_relevance;
+std::vector<Document> SearchServer::FindAllDocuments(const QueryTerms& query, DocumentPredicate document_predicate) const {
+    // Накопитель релевантности потока: без выделения памяти между запросами
+    ScoreAccumulator& document_to_relevance = GetThreadScoreAccumulator();
+    document_to_relevance.Reset(document_external_ids_.size());
 
-    // Находим документы, содержащие плюс слова
-    for (auto& word_view : query.plus_words) {
-        // Преобразуем указатель в строку для возможности работы встроенных методов
-        std::string word_string{ word_view };
+    // Буфер для распаковки сжатых списков документов
+    thread_local InvertedIndex::PostingBuffer buffer;
 
-        // Если слова нет, переходим к следующему слову
-        if (word_to_document_freqs_.count(word_string) == 0) {
+    // Докуметы, сожержащие минус слова, исключаются до подсчета релевантности
+    const DocumentBitmap excluded_documents = GetExcludedDocuments(query, buffer);
+
+    // Находим документы, содержащие плюс слова
+    for (size_t term_index = 0; term_index < query.plus_term_ids.size(); ++term_index) {
+        // Список документов слова. Пустой, если все документы со словом удалены
+        const auto postings = index_.GetPostings(query.plus_term_ids[term_index], buffer);
+        if (postings.empty()) {
             continue;
         }
 
-        // Считаем инверсированную частоту слова
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word_string);
+        // Инверсированная частота слова (из кэша индекса или из запроса)
+        const double inverse_document_freq = query.plus_inverse_document_freqs[term_index];
 
-        // Проходим по связанному со словом словарю для доступа к документам, связанным с этим словом
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word_string)) {
-            // Берем информацию о документе
-            const auto& document_data = documents_.at(document_id);
+        // Проходим по списку документов, связанных с этим словом
+        for (size_t i = 0; i < postings.size; ++i) {
+            const int ordinal = postings.ordinals[i];
 
             // Проверяем документ на доплнительные условаия. Если ок, то увеличиваем релевантность документа
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+            if (!excluded_documents.Contains(ordinal)
+                && IsAccepted(document_predicate, ordinal)) {
+                document_to_relevance.Add(ordinal, postings.term_freqs[i] * inverse_document_freq);
             }
         }
     }
 
+    // Контейнер для возврата найденных документов
+    std::vector<Document> matched_documents;
+
+    // Переносим документы из поиска в вывод в порядке номеров, присваивая нужные параметры
+    for (const int ordinal : document_to_relevance.GetTouched()) {
+        matched_documents.push_back(
+            { document_external_ids_[ordinal], document_to_relevance.GetScore(ordinal), document_ratings_[ordinal] });
+    }
+
+    return matched_documents;
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsMaxScore(
+    const QueryTerms& query,
+    DocumentPredicate document_predicate,
+    size_t max_count,
+    bool use_block_max) const {
+
+    if (max_count == 0) {
+        return {};
+    }
+
+    // Документы с минус словами
+    InvertedIndex::PostingBuffer minus_buffer;
+    const DocumentBitmap excluded_documents = GetExcludedDocuments(query, minus_buffer);
+
+    // Курсоры по спискам плюс слов. Каждому курсору нужен свой буфер распаковки
+    std::vector<InvertedIndex::PostingBuffer> buffers(query.plus_term_ids.size());
+    std::vector<PostingCursor> cursors;
+    cursors.reserve(query.plus_term_ids.size());
+    for (size_t i = 0; i < query.plus_term_ids.size(); ++i) {
+        const int term_id = query.plus_term_ids[i];
+        const auto postings = index_.GetPostings(term_id, buffers[i]);
+        if (postings.empty()) {
+            continue;
+        }
+        const double inverse_document_freq = query.plus_inverse_document_freqs[i];
+        cursors.emplace_back(postings, inverse_document_freq,
+            index_.GetMaxTermFreq(term_id) * inverse_document_freq, static_cast<int>(i));
+    }
+
+    // Курсоры по возрастанию верхней оценки и суммы оценок префиксов:
+    // prefix_max_scores[i] - верхняя оценка документа, содержащего лишь слова курсоров 0..i
+    std::sort(cursors.begin(), cursors.end(), [](const PostingCursor& lhs, const PostingCursor& rhs) {
+        return lhs.GetMaxScore() < rhs.GetMaxScore();
+    });
+    std::vector<double> prefix_max_scores(cursors.size());
+    double prefix_max_score = 0.0;
+    for (size_t i = 0; i < cursors.size(); ++i) {
+        prefix_max_score += cursors[i].GetMaxScore();
+        prefix_max_scores[i] = prefix_max_score;
+    }
 
-    // Находим докуметы, сожержащие минус слова
-    for (auto& word_view : query.minus_words) {
-        // Преобразуем указатель в строку для возможности работы встроенных методов
-        std::string word_string{ word_view };
+    // Документ попадает в выдачу, только если его релевантность больше
+    // релевантности худшего отобранного с точностью RELEVANCE_COMPARE_ACCURACY
+    double threshold = -std::numeric_limits<double>::infinity();
+
+    // Курсоры начиная с first_essential - существенные: документ, не содержащий
+    // ни одного их слова, не может пройти порог. Кандидаты берутся только из них
+    size_t first_essential = 0;
+
+    // Оценка по блокам существенных слов, в которых лежит текущий документ, и
+    // последний документ, для которого она верна. Пересчитывается при выходе за
+    // этот документ или при сокращении множества существенных слов
+    double block_max_score = 0.0;
+    int block_last_ordinal = -1;
+    size_t block_first_essential = 0;
+
+    // Позиции в запросе и вклады слов текущего документа
+    std::vector<std::pair<int, double>> matched;
+
+    TopDocuments top(max_count);
+    while (first_essential < cursors.size()) {
+        // Кандидат - наименьший документ среди существенных курсоров
+        int ordinal = PostingCursor::END;
+        for (size_t i = first_essential; i < cursors.size(); ++i) {
+            ordinal = std::min(ordinal, cursors[i].GetOrdinal());
+        }
+        if (ordinal == PostingCursor::END) {
+            break;
+        }
 
-        // Если слова нет, переходим к следующему слову
-        if (word_to_document_freqs_.count(word_string) == 0) {
+        if (use_block_max && top.IsFull()) {
+            if (ordinal > block_last_ordinal || block_first_essential != first_essential) {
+                block_max_score = first_essential > 0 ? prefix_max_scores[first_essential - 1] : 0.0;
+                block_last_ordinal = PostingCursor::END;
+                block_first_essential = first_essential;
+                for (size_t i = first_essential; i < cursors.size(); ++i) {
+                    cursors[i].ShallowSkipTo(ordinal);
+                    block_max_score += cursors[i].GetBlockMaxScore();
+                    block_last_ordinal = std::min(block_last_ordinal, cursors[i].GetBlockLastOrdinal());
+                }
+            }
+
+            // Ни один документ до block_last_ordinal включительно не проходит порог
+            if (block_max_score <= threshold) {
+                const int next_ordinal = block_last_ordinal == PostingCursor::END ? PostingCursor::END : block_last_ordinal + 1;
+                for (size_t i = first_essential; i < cursors.size(); ++i) {
+                    cursors[i].SkipTo(next_ordinal);
+                }
+                continue;
+            }
+        }
+
+        matched.clear();
+        double score = 0.0;
+        for (size_t i = first_essential; i < cursors.size(); ++i) {
+            if (cursors[i].GetOrdinal() == ordinal) {
+                score += cursors[i].GetScore();
+                matched.emplace_back(cursors[i].GetTermOrder(), cursors[i].GetScore());
+                cursors[i].Next();
+            }
+        }
+
+        if (excluded_documents.Contains(ordinal)
+            || !IsAccepted(document_predicate, ordinal)) {
             continue;
         }
 
-        // Проверяем какие документы содержат минус слова и удаляем их из выдачи
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word_string)) {
-            document_to_relevance.erase(document_id);
+        // Досчитываем несущественные слова от самых весомых, пока оставшаяся
+        // верхняя оценка позволяет документу пройти порог. Оценку очередного
+        // слова по возможности уточняем оценкой его блока
+        bool is_pruned = false;
+        for (size_t i = first_essential; i > 0; --i) {
+            if (score + prefix_max_scores[i - 1] <= threshold) {
+                is_pruned = true;
+                break;
+            }
+            PostingCursor& cursor = cursors[i - 1];
+            if (use_block_max) {
+                cursor.ShallowSkipTo(ordinal);
+                if (score + cursor.GetBlockMaxScore() + (i > 1 ? prefix_max_scores[i - 2] : 0.0) <= threshold) {
+                    is_pruned = true;
+                    break;
+                }
+            }
+            cursor.SkipTo(ordinal);
+            if (cursor.GetOrdinal() == ordinal) {
+                score += cursor.GetScore();
+                matched.emplace_back(cursor.GetTermOrder(), cursor.GetScore());
+            }
+        }
+        if (is_pruned) {
+            continue;
         }
-    }
 
-    // Контейнер для возврата найденных документов
-    std::vector<Document> matched_documents;
+        // Итоговую релевантность складываем в порядке слов запроса, как полный перебор
+        std::sort(matched.begin(), matched.end());
+        double relevance = 0.0;
+        for (const auto& [term_order, term_score] : matched) {
+            relevance += term_score;
+        }
 
-    // Переносим документы из поиска в вывод, присваивая нужные параметры
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back(
-            { document_id, relevance, documents_.at(document_id).rating });
+        if (top.Add({ document_external_ids_[ordinal], relevance, document_ratings_[ordinal] }) && top.IsFull()) {
+            threshold = top.GetWorst().relevance - RELEVANCE_COMPARE_ACCURACY;
+            while (first_essential < cursors.size() && prefix_max_scores[first_essential] <= threshold) {
+                ++first_essential;
+            }
+        }
     }
 
-    return matched_documents;
+    return top.Extract();
+}
+
+template <typename ExecutionPolicy, typename Func>
+void SearchServer::ForEachIndex(ExecutionPolicy&& policy, size_t count, Func func) const {
+    ::ForEachIndex(policy, thread_pool_.get(), count, func);
+}
+
+template <typename DocumentPredicate>
+bool SearchServer::IsAccepted(const DocumentPredicate& document_predicate, int ordinal) const {
+    if constexpr (std::is_same_v<DocumentPredicate, StatusPredicate>) {
+        return status_documents_[static_cast<size_t>(document_predicate.status)].Contains(ordinal);
+    }
+    else {
+        // Списки могут содержать удаленные документы до уплотнения. Из битовых
+        // карт статусов они убираются сразу
+        return !index_.IsDeleted(ordinal)
+            && document_predicate(document_external_ids_[ordinal], document_statuses_[ordinal], document_ratings_[ordinal]);
+    }
 }
 
 // Многопоточная версия FindAllDocuments с последовательным параметром
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindAllDocuments(
     const std::execution::sequenced_policy& policy,
-    Query& query,
+    const QueryTerms& query,
     DocumentPredicate document_predicate) const {
 
     return FindAllDocuments(query, document_predicate);
@@ -364,73 +1013,450 @@ std::vector<Document> SearchServer::FindAllDocuments(
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindAllDocuments(
     const std::execution::parallel_policy& policy,
-    Query& query,
+    const QueryTerms& query,
     DocumentPredicate document_predicate) const {
 
-    // Контейнер для хранения найденных документов, 
-    //std::map<int, double> document_to_relevance;
-    ConcurrentMap<int, double> document_to_relevance(MAX_BUCKETS_DURING_SEARCH);
-
-    // Проверяем есть ли слово в базе и, если есть, обрабатываем
-    auto is_plus_presented = [&](auto& word_view) {
-        // Преобразуем указатель в строку для возможности работы встроенных методов
-        std::string word_string{ word_view };
-
-        // Если слова нет, пропускаем его
-        if (word_to_document_freqs_.count(word_string) != 0) {
-            // Считаем инверсированную частоту слова
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word_string);
-
-            // Проходим по связанному со словом словарю для доступа к документам, связанным с этим словом
-            for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word_string)) {
-                // Берем информацию о документе
-                const auto& document_data = documents_.at(document_id);
-
-                // Проверяем документ на дополнительные условия. Если ок,
-                // то увеличиваем релевантность документа
-                if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                    document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
-                }
+    // Диапазоны документов обрабатываются независимо, каждый в накопителе своего потока
+    const auto postings = GetQueryPostings(query);
+    const auto ranges = GetSearchRanges();
+    std::vector<std::vector<Document>> range_documents(ranges.size());
+
+    ForEachIndex(policy, ranges.size(), [&](size_t i) {
+        auto& documents = range_documents[i];
+        ScoreDocumentRange(postings, document_predicate, ranges[i].first, ranges[i].second,
+            [&documents](const Document& document) { documents.push_back(document); });
+    });
+
+    // Контейнер для возврата найденных документов
+    std::vector<Document> matched_documents;
+    for (const auto& documents : range_documents) {
+        matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
+    }
+
+    return matched_documents;
+}
+
+template <typename DocumentPredicate, typename DocumentConsumer>
+void SearchServer::ScoreDocumentRange(
+    const QueryPostings& postings,
+    DocumentPredicate document_predicate,
+    int begin,
+    int end,
+    DocumentConsumer consumer) const {
+
+    ScoreAccumulator& document_to_relevance = GetThreadScoreAccumulator();
+    document_to_relevance.Reset(document_external_ids_.size());
+
+    // Часть списка, попадающая в диапазон: списки отсортированы по номеру документа
+    auto get_range = [begin, end](const InvertedIndex::PostingList& list) {
+        const int* range_begin = std::lower_bound(list.ordinals, list.ordinals + list.size, begin);
+        const int* range_end = std::lower_bound(range_begin, list.ordinals + list.size, end);
+        return std::make_pair(range_begin - list.ordinals, range_end - list.ordinals);
+    };
+
+    for (const auto& [list, inverse_document_freq] : postings.plus_postings) {
+        const auto [first, last] = get_range(list);
+        for (auto i = first; i < last; ++i) {
+            const int ordinal = list.ordinals[i];
+            if (!postings.excluded_documents.Contains(ordinal)
+                && IsAccepted(document_predicate, ordinal)) {
+                document_to_relevance.Add(ordinal, list.term_freqs[i] * inverse_document_freq);
             }
         }
+    }
+
+    for (const int ordinal : document_to_relevance.GetTouched()) {
+        consumer(Document{ document_external_ids_[ordinal], document_to_relevance.GetScore(ordinal), document_ratings_[ordinal] });
+    }
+}
+
+template <typename ExecutionPolicy>
+void SearchServer::AddDocumentsImpl(ExecutionPolicy&& policy, const std::vector<DocumentInput>& documents) {
+    // Номера проверяются до изменения сервера
+    std::unordered_set<int> batch_ids;
+    batch_ids.reserve(documents.size());
+    for (const DocumentInput& document : documents) {
+        if (document.id < 0 || document_id_to_ordinal_.count(document.id) > 0 || !batch_ids.insert(document.id).second) {
+            throw std::invalid_argument(std::string("Invalid document_id"));
+        }
+    }
+    if (documents.empty()) {
+        return;
+    }
+
+    // Частичный индекс части пакета: слова части в порядке первого появления
+    // и вхождения с номерами слов части и номерами документов в пакете
+    struct PartialIndex {
+        std::vector<std::string_view> words;
+        std::vector<int> term_ids;
+        std::vector<InvertedIndex::TermPosting> postings;
+        std::exception_ptr error;
     };
 
-    // Находим документы, содержащие плюс слова
-    for_each(policy,
-        query.plus_words.begin(), query.plus_words.end(),
-        is_plus_presented);
+    const size_t document_count = documents.size();
+    const size_t thread_count = thread_pool_ ? thread_pool_->GetThreadCount() : std::max(1u, std::thread::hardware_concurrency());
+    const size_t part_count = std::min(document_count, thread_count * 4);
+    std::vector<PartialIndex> parts(part_count);
+    std::vector<int> word_counts(document_count);
+
+    // Разбор текстов и подсчет вхождений. Исключение части сохраняется и
+    // пробрасывается после разбора: из std::execution::par оно бы завершило программу
+    ForEachIndex(policy, part_count, [&](size_t part_index) {
+        PartialIndex& part = parts[part_index];
+        try {
+            std::unordered_map<std::string_view, int> part_term_ids;
+            std::vector<std::string_view> words;
+            for (size_t i = document_count * part_index / part_count; i < document_count * (part_index + 1) / part_count; ++i) {
+                words = SplitIntoWordsNoStop(documents[i].text);
+                word_counts[i] = static_cast<int>(words.size());
+                std::sort(words.begin(), words.end());
+                for (size_t begin = 0, end = 0; begin < words.size(); begin = end) {
+                    while (end < words.size() && words[end] == words[begin]) {
+                        ++end;
+                    }
+                    const auto [it, is_new] = part_term_ids.emplace(words[begin], static_cast<int>(part.words.size()));
+                    if (is_new) {
+                        part.words.push_back(words[begin]);
+                    }
+                    part.postings.push_back({ it->second, static_cast<int>(i), static_cast<uint32_t>(end - begin) });
+                }
+            }
+        }
+        catch (...) {
+            part.error = std::current_exception();
+        }
+    });
+    for (const PartialIndex& part : parts) {
+        if (part.error) {
+            std::rethrow_exception(part.error);
+        }
+    }
 
-    
-    // Проверяем есть ли слово в базе и, если есть, обрабатываем
-    auto is_minus_presented = [&](auto& word_view) {
-        // Преобразуем указатель в строку для возможности работы встроенных методов
-        std::string word_string{ word_view };
-
-        // Если слова нет, переходим к следующему слову
-        if (word_to_document_freqs_.count(word_string) != 0) {
-            // Проверяем какие документы содержат минус слова и удаляем их из выдачи
-            for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word_string)) {
-               // document_to_relevance.erase(document_id);
-                document_to_relevance[document_id].ref_to_value = 0;
+    // Номера слов в словаре сервера. Словарь пополняется последовательно,
+    // но только уникальными словами частей
+    std::vector<size_t> part_offsets(part_count + 1, 0);
+    for (size_t i = 0; i < part_count; ++i) {
+        PartialIndex& part = parts[i];
+        part.term_ids.reserve(part.words.size());
+        for (const std::string_view word : part.words) {
+            part.term_ids.push_back(terms_.AddTerm(word));
+        }
+        part_offsets[i + 1] = part_offsets[i] + part.postings.size();
+    }
+
+    // Вхождения в номерах словаря и ordinal, словари слов документов
+    const int first_ordinal = static_cast<int>(document_external_ids_.size());
+    std::vector<InvertedIndex::TermPosting> postings(part_offsets.back());
+    std::vector<std::map<std::string_view, double>> word_freqs(document_count);
+    ForEachIndex(policy, part_count, [&](size_t part_index) {
+        const PartialIndex& part = parts[part_index];
+        for (size_t i = 0; i < part.postings.size(); ++i) {
+            const auto& posting = part.postings[i];
+            const int term_id = part.term_ids[posting.term_id];
+            postings[part_offsets[part_index] + i] = { term_id, first_ordinal + posting.ordinal, posting.count };
+            // Частота считается так же, как в AddDocument
+            const double inv_word_count = 1.0 / word_counts[posting.ordinal];
+            word_freqs[posting.ordinal].emplace(terms_.GetWord(term_id), posting.count * inv_word_count);
+        }
+    });
+
+    // Инвертирование: одна сортировка вхождений пакета по (слово, документ).
+    // Индекс вливает отсортированный буфер без повторной сортировки
+    std::sort(policy, postings.begin(), postings.end(),
+        [](const InvertedIndex::TermPosting& lhs, const InvertedIndex::TermPosting& rhs) {
+            return lhs.term_id != rhs.term_id ? lhs.term_id < rhs.term_id : lhs.ordinal < rhs.ordinal;
+        });
+    index_.AddDocuments(first_ordinal, word_counts, std::move(postings));
+
+    // Колонки свойств документов
+    document_id_to_ordinal_.reserve(document_id_to_ordinal_.size() + document_count);
+    document_external_ids_.reserve(document_external_ids_.size() + document_count);
+    document_ratings_.reserve(document_ratings_.size() + document_count);
+    document_statuses_.reserve(document_statuses_.size() + document_count);
+    document_word_freqs_.reserve(document_word_freqs_.size() + document_count);
+    for (size_t i = 0; i < document_count; ++i) {
+        const DocumentInput& document = documents[i];
+        const int ordinal = first_ordinal + static_cast<int>(i);
+        document_id_to_ordinal_.emplace(document.id, ordinal);
+        document_external_ids_.push_back(document.id);
+        document_ratings_.push_back(ComputeAverageRating(document.ratings));
+        document_statuses_.push_back(document.status);
+        status_documents_[static_cast<size_t>(document.status)].Add(ordinal);
+        document_word_freqs_.push_back(std::move(word_freqs[i]));
+        document_ids_.insert(document.id);
+    }
+}
+
+template <typename ExecutionPolicy>
+void SearchServer::RemoveDocumentsImpl(ExecutionPolicy&& policy, const std::vector<int>& document_ids) {
+    // Колонки свойств меняются последовательно: отсутствующие и повторные номера пропускаются
+    std::vector<int> ordinals;
+    ordinals.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        const auto it = document_id_to_ordinal_.find(document_id);
+        if (it == document_id_to_ordinal_.end()) {
+            continue;
+        }
+        const int ordinal = it->second;
+        ordinals.push_back(ordinal);
+        status_documents_[static_cast<size_t>(document_statuses_[ordinal])].Remove(ordinal);
+        document_id_to_ordinal_.erase(it);
+        document_ids_.erase(document_id);
+    }
+    if (ordinals.empty()) {
+        return;
+    }
+
+    // Слова удаляемых документов группируются по частям: индексу нужен только
+    // набор затронутых слов, а не пары (документ, слово)
+    const size_t thread_count = thread_pool_ ? thread_pool_->GetThreadCount() : std::max(1u, std::thread::hardware_concurrency());
+    const size_t part_count = std::min(ordinals.size(), thread_count * 4);
+    std::vector<std::vector<int>> part_term_ids(part_count);
+    ForEachIndex(policy, part_count, [&](size_t part_index) {
+        std::vector<int>& term_ids = part_term_ids[part_index];
+        for (size_t i = ordinals.size() * part_index / part_count; i < ordinals.size() * (part_index + 1) / part_count; ++i) {
+            auto& word_freqs = document_word_freqs_[ordinals[i]];
+            for (const auto& [word, freq] : word_freqs) {
+                term_ids.push_back(terms_.FindTerm(word));
             }
+            word_freqs.clear();
         }
-    };
+    });
 
-    for_each(policy,
-        query.minus_words.begin(), query.minus_words.end(),
-        is_minus_presented);
+    std::vector<int> term_ids;
+    for (const auto& ids : part_term_ids) {
+        term_ids.insert(term_ids.end(), ids.begin(), ids.end());
+    }
 
-    // Контейнер для возврата найденных документов
-    std::vector<Document> matched_documents;
+    // Затронутые списки переписываются сразу, один раз на весь пакет
+    index_.RemoveDocuments(ordinals, term_ids);
+    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::parallel_policy>) {
+        index_.Merge(policy, thread_pool_.get());
+    }
+    else {
+        index_.Merge();
+    }
+}
+
+template <typename ExecutionPolicy>
+DocumentMatches SearchServer::MatchDocumentsImpl(
+    ExecutionPolicy&& policy,
+    const PreparedQuery& prepared_query,
+    const std::vector<int>& document_ids) const {
+
+    DocumentMatches matches;
+
+    // Внутренние номера документов по возрастанию вместе с позицией в document_ids.
+    // Заодно проверяем, что все документы есть в базе
+    std::vector<std::pair<int, uint32_t>> sorted_documents;
+    sorted_documents.reserve(document_ids.size());
+    matches.statuses.reserve(document_ids.size());
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        const int ordinal = GetOrdinal(document_ids[i]);
+        sorted_documents.emplace_back(ordinal, static_cast<uint32_t>(i));
+        matches.statuses.push_back(document_statuses_[ordinal]);
+    }
+    std::sort(sorted_documents.begin(), sorted_documents.end());
+
+    // Номера слов запроса в словаре сервера
+    const auto query = ResolveQuery(prepared_query);
+    const size_t word_count = query.plus_term_ids.size();
+    for (const int term_id : query.plus_term_ids) {
+        matches.words.push_back(terms_.GetWord(term_id));
+    }
+
+    // Документы с минус словами
+    InvertedIndex::PostingBuffer minus_buffer;
+    const DocumentBitmap excluded_documents = GetExcludedDocuments(query, minus_buffer);
 
-    // Переносим документы из поиска в вывод, присваивая нужные параметры
-    for (const auto& [document_id, relevance] : document_to_relevance.BuildOrdinaryMap()) {
-        if (relevance > 0) {
-            matched_documents.push_back(
-                { document_id, relevance, documents_.at(document_id).rating });
+    // Списки плюс слов распаковываются заранее, каждый в свой буфер
+    std::vector<InvertedIndex::PostingBuffer> buffers(word_count);
+    std::vector<InvertedIndex::PostingList> postings;
+    postings.reserve(word_count);
+    for (size_t i = 0; i < word_count; ++i) {
+        postings.push_back(index_.GetPostings(query.plus_term_ids[i], buffers[i]));
+    }
+
+    // Пересечение списка каждого слова с документами запроса: позиции
+    // документов, содержащих слово. Короткая сторона пересечения проходится
+    // подряд, по длинной выполняется галопирующий или бинарный поиск
+    std::vector<std::vector<uint32_t>> word_positions(word_count);
+
+    ForEachIndex(policy, word_count, [&](size_t word_index) {
+        PostingCursor cursor(postings[word_index], 0.0, 0.0, static_cast<int>(word_index));
+        auto& positions = word_positions[word_index];
+
+        auto it = sorted_documents.begin();
+        while (it != sorted_documents.end()) {
+            cursor.SkipTo(it->first);
+            const int ordinal = cursor.GetOrdinal();
+            if (ordinal == PostingCursor::END) {
+                break;
+            }
+            if (ordinal != it->first) {
+                it = std::lower_bound(it, sorted_documents.end(), std::make_pair(ordinal, uint32_t{ 0 }));
+                continue;
+            }
+
+            // Все вхождения документа в document_ids
+            const bool is_excluded = excluded_documents.Contains(ordinal);
+            for (; it != sorted_documents.end() && it->first == ordinal; ++it) {
+                if (!is_excluded) {
+                    positions.push_back(it->second);
+                }
+            }
+        }
+    });
+
+    // Количество слов каждого документа, префиксные суммы и раскладка номеров
+    // слов по документам. Слова обходятся по возрастанию, поэтому слова
+    // документа тоже идут по возрастанию
+    matches.offsets.assign(document_ids.size() + 1, 0);
+    for (const auto& positions : word_positions) {
+        for (const uint32_t position : positions) {
+            ++matches.offsets[position + 1];
         }
     }
+    std::partial_sum(matches.offsets.begin(), matches.offsets.end(), matches.offsets.begin());
 
+    matches.word_indices.resize(matches.offsets.back());
+    std::vector<size_t> next_slot(matches.offsets.begin(), matches.offsets.end() - 1);
+    for (size_t word_index = 0; word_index < word_count; ++word_index) {
+        for (const uint32_t position : word_positions[word_index]) {
+            matches.word_indices[next_slot[position]++] = static_cast<uint32_t>(word_index);
+        }
+    }
 
-    return matched_documents;
-}
\ No newline at end of file
+    return matches;
+}
+
+template <typename ExecutionPolicy>
+std::vector<std::vector<Document>> SearchServer::FindTopDocumentsBatchImpl(
+    ExecutionPolicy&& policy,
+    const std::vector<PreparedQuery>& prepared_queries,
+    DocumentStatus status,
+    const SearchOptions& options) const {
+
+    const size_t query_count = prepared_queries.size();
+    std::vector<QueryTerms> queries(query_count);
+    ForEachIndex(policy, query_count, [&](size_t i) {
+        queries[i] = ResolveQuery(prepared_queries[i]);
+    });
+
+    // Слова пакета без повторов по возрастанию номера
+    std::vector<int> batch_terms;
+    for (const auto& query : queries) {
+        batch_terms.insert(batch_terms.end(), query.plus_term_ids.begin(), query.plus_term_ids.end());
+        batch_terms.insert(batch_terms.end(), query.minus_term_ids.begin(), query.minus_term_ids.end());
+    }
+    std::sort(batch_terms.begin(), batch_terms.end());
+    batch_terms.erase(std::unique(batch_terms.begin(), batch_terms.end()), batch_terms.end());
+
+    // Списки документов слов пакета, по одному разу на слово
+    std::vector<InvertedIndex::PostingBuffer> buffers(batch_terms.size());
+    std::vector<InvertedIndex::PostingList> postings;
+    postings.reserve(batch_terms.size());
+    for (size_t i = 0; i < batch_terms.size(); ++i) {
+        postings.push_back(index_.GetPostings(batch_terms[i], buffers[i]));
+    }
+
+    // Ранг слова в порядке самих слов. В этом порядке идут плюс слова каждого
+    // запроса, поэтому релевантность складывается так же, как при отдельном поиске
+    std::vector<size_t> terms_by_word(batch_terms.size());
+    std::iota(terms_by_word.begin(), terms_by_word.end(), 0);
+    std::sort(terms_by_word.begin(), terms_by_word.end(), [&](size_t lhs, size_t rhs) {
+        return terms_.GetWord(batch_terms[lhs]) < terms_.GetWord(batch_terms[rhs]);
+    });
+    std::vector<size_t> word_ranks(batch_terms.size());
+    for (size_t rank = 0; rank < terms_by_word.size(); ++rank) {
+        word_ranks[terms_by_word[rank]] = rank;
+    }
+
+    auto get_term_index = [&batch_terms](int term_id) {
+        return static_cast<size_t>(std::lower_bound(batch_terms.begin(), batch_terms.end(), term_id) - batch_terms.begin());
+    };
+
+    // Запросы упорядочиваются по самому длинному списку плюс слова: запросы,
+    // которым нужен один и тот же тяжелый список, попадают в одну группу
+    std::vector<size_t> heaviest_terms(query_count, batch_terms.size());
+    for (size_t i = 0; i < query_count; ++i) {
+        size_t heaviest_size = 0;
+        for (const int term_id : queries[i].plus_term_ids) {
+            const size_t term_index = get_term_index(term_id);
+            if (heaviest_terms[i] == batch_terms.size() || postings[term_index].size > heaviest_size) {
+                heaviest_terms[i] = term_index;
+                heaviest_size = postings[term_index].size;
+            }
+        }
+    }
+    std::vector<size_t> query_order(query_count);
+    std::iota(query_order.begin(), query_order.end(), 0);
+    std::stable_sort(query_order.begin(), query_order.end(), [&heaviest_terms](size_t lhs, size_t rhs) {
+        return heaviest_terms[lhs] < heaviest_terms[rhs];
+    });
+
+    const size_t group_size = QueryGroupAccumulator::MAX_QUERY_COUNT;
+    const size_t group_count = (query_count + group_size - 1) / group_size;
+
+    const StatusPredicate document_predicate{ status };
+    std::vector<std::vector<Document>> results(query_count);
+
+    ForEachIndex(policy, group_count, [&](size_t group) {
+        const size_t group_begin = group * group_size;
+        const size_t group_end = std::min(group_begin + group_size, query_count);
+
+        // Плюс слова группы в порядке слов: (ранг слова, IDF слова в запросе,
+        // запрос в группе). IDF одного слова совпадает у запросов без собственной статистики
+        std::vector<std::tuple<size_t, double, size_t>> group_terms;
+        std::array<DocumentBitmap, QueryGroupAccumulator::MAX_QUERY_COUNT> excluded_documents;
+        for (size_t i = group_begin; i < group_end; ++i) {
+            const QueryTerms& query = queries[query_order[i]];
+            for (size_t j = 0; j < query.plus_term_ids.size(); ++j) {
+                group_terms.emplace_back(word_ranks[get_term_index(query.plus_term_ids[j])],
+                    query.plus_inverse_document_freqs[j], i - group_begin);
+            }
+            for (const int term_id : query.minus_term_ids) {
+                const auto& list = postings[get_term_index(term_id)];
+                excluded_documents[i - group_begin].AddSorted(list.ordinals, list.size);
+            }
+        }
+        std::sort(group_terms.begin(), group_terms.end());
+
+        // Список каждого слова проходится один раз для всех запросов группы с этим словом
+        QueryGroupAccumulator& accumulator = GetThreadQueryGroupAccumulator();
+        accumulator.Reset(document_external_ids_.size());
+        for (size_t i = 0; i < group_terms.size();) {
+            const auto [rank, inverse_document_freq, first_query] = group_terms[i];
+            uint8_t query_mask = 0;
+            for (; i < group_terms.size() && std::get<0>(group_terms[i]) == rank
+                && std::get<1>(group_terms[i]) == inverse_document_freq; ++i) {
+                query_mask |= static_cast<uint8_t>(1u << std::get<2>(group_terms[i]));
+            }
+
+            const auto& list = postings[terms_by_word[rank]];
+            for (size_t j = 0; j < list.size; ++j) {
+                accumulator.Add(list.ordinals[j], query_mask, list.term_freqs[j] * inverse_document_freq);
+            }
+        }
+
+        // Отбор лучших документов каждого запроса в порядке номеров, как при отдельном поиске
+        std::vector<TopDocuments> tops(group_end - group_begin, TopDocuments(options.max_result_count));
+        for (const int ordinal : accumulator.GetTouched()) {
+            if (!IsAccepted(document_predicate, ordinal)) {
+                continue;
+            }
+            const uint8_t query_mask = accumulator.GetQueryMask(ordinal);
+            for (size_t query = 0; (query_mask >> query) != 0; ++query) {
+                if (((query_mask >> query) & 1) && !excluded_documents[query].Contains(ordinal)) {
+                    tops[query].Add({ document_external_ids_[ordinal], accumulator.GetScore(ordinal, query), document_ratings_[ordinal] });
+                }
+            }
+        }
+
+        for (size_t i = group_begin; i < group_end; ++i) {
+            results[query_order[i]] = tops[i - group_begin].Extract();
+        }
+    });
+
+    return results;
+}
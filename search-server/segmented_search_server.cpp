@@ -0,0 +1,109 @@
+#include "segmented_search_server.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+SegmentedSearchServer::SegmentedSearchServer(string_view stop_words_text, size_t segment_count) {
+    if (segment_count == 0) {
+        throw invalid_argument("Segment count must be positive"s);
+    }
+    segments_.reserve(segment_count);
+    for (size_t i = 0; i < segment_count; ++i) {
+        segments_.emplace_back(stop_words_text);
+    }
+}
+
+void SegmentedSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    if (document_id < 0) {
+        throw invalid_argument("Invalid document_id"s);
+    }
+    // Повтор номера обнаружит сегмент: одинаковые номера попадают в один сегмент
+    segments_[GetSegmentIndex(document_id)].AddDocument(document_id, document, status, ratings);
+}
+
+void SegmentedSearchServer::RemoveDocument(int document_id) {
+    if (document_id < 0) {
+        return;
+    }
+    segments_[GetSegmentIndex(document_id)].RemoveDocument(document_id);
+}
+
+int SegmentedSearchServer::GetDocumentCount() const {
+    int document_count = 0;
+    for (const SearchServer& segment : segments_) {
+        document_count += segment.GetDocumentCount();
+    }
+    return document_count;
+}
+
+size_t SegmentedSearchServer::GetSegmentCount() const {
+    return segments_.size();
+}
+
+const SearchServer& SegmentedSearchServer::GetSegment(size_t index) const {
+    return segments_.at(index);
+}
+
+void SegmentedSearchServer::SetThreadPool(shared_ptr<ThreadPool> thread_pool) {
+    thread_pool_ = move(thread_pool);
+}
+
+PreparedQuery SegmentedSearchServer::PrepareQuery(string_view raw_query) const {
+    return segments_.front().PrepareQuery(raw_query);
+}
+
+PreparedQuery WithGlobalStatistics(const PreparedQuery& query, const vector<const SearchServer*>& segments) {
+    vector<size_t> document_freqs(query.GetPlusWords().size(), 0);
+    int document_count = 0;
+    for (const SearchServer* segment : segments) {
+        const vector<size_t> segment_freqs = segment->GetDocumentFreqs(query);
+        document_count += segment->GetDocumentCount();
+        for (size_t i = 0; i < document_freqs.size(); ++i) {
+            document_freqs[i] += segment_freqs[i];
+        }
+    }
+    return WithGlobalStatistics(query, document_freqs, document_count);
+}
+
+PreparedQuery WithGlobalStatistics(const PreparedQuery& query, const vector<size_t>& document_freqs, int document_count) {
+    // IDF считается по той же формуле, что и в InvertedIndex, из суммарных
+    // количеств документов, поэтому совпадает с IDF единого индекса
+    vector<double> inverse_document_freqs;
+    inverse_document_freqs.reserve(document_freqs.size());
+    for (const size_t document_freq : document_freqs) {
+        inverse_document_freqs.push_back(document_freq == 0 ? 0.0 : log(document_count * 1.0 / document_freq));
+    }
+
+    PreparedQuery global_query = query;
+    global_query.SetInverseDocumentFreqs(move(inverse_document_freqs));
+    return global_query;
+}
+
+PreparedQuery SegmentedSearchServer::WithGlobalStatistics(const PreparedQuery& query) const {
+    return ::WithGlobalStatistics(query, GetSegmentPointers());
+}
+
+vector<Document> SegmentedSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
+    return FindTopDocuments(execution::seq, raw_query, status);
+}
+
+tuple<vector<string_view>, DocumentStatus> SegmentedSearchServer::MatchDocument(string_view raw_query, int document_id) const {
+    return segments_[GetSegmentIndex(document_id)].MatchDocument(raw_query, document_id);
+}
+
+vector<const SearchServer*> SegmentedSearchServer::GetSegmentPointers() const {
+    vector<const SearchServer*> segments;
+    segments.reserve(segments_.size());
+    for (const SearchServer& segment : segments_) {
+        segments.push_back(&segment);
+    }
+    return segments;
+}
+
+size_t SegmentedSearchServer::GetSegmentIndex(int document_id) const {
+    if (document_id < 0) {
+        throw out_of_range("Document id not found"s);
+    }
+    return static_cast<size_t>(document_id) % segments_.size();
+}
@@ -0,0 +1,190 @@
+#pragma once
+#include <cmath>
+#include <execution>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "document.h"
+#include "prepared_query.h"
+#include "search_server.h"
+#include "thread_pool.h"
+#include "top_documents.h"
+
+// Копия запроса с IDF плюс слов, посчитанными по всем серверам segments
+// вместе, как по одному индексу
+PreparedQuery WithGlobalStatistics(const PreparedQuery& query, const std::vector<const SearchServer*>& segments);
+
+// Копия запроса с IDF плюс слов по общим количествам: document_freqs[i] -
+// документов с i-м плюс словом, document_count - всех документов
+PreparedQuery WithGlobalStatistics(const PreparedQuery& query, const std::vector<size_t>& document_freqs, int document_count);
+
+// Общая выдача из лучших документов segment_count серверов: search(i)
+// возвращает лучшие документы i-го сервера. Для parallel_policy серверы
+// обходятся параллельно
+template <typename ExecutionPolicy, typename SegmentSearch>
+std::vector<Document> MergeSegmentTopDocuments(
+    ExecutionPolicy&& policy,
+    ThreadPool* thread_pool,
+    size_t segment_count,
+    size_t max_count,
+    SegmentSearch search) {
+
+    std::vector<std::vector<Document>> segment_top_documents(segment_count);
+    ForEachIndex(policy, thread_pool, segment_count, [&](size_t i) {
+        segment_top_documents[i] = search(i);
+    });
+
+    TopDocuments top(max_count);
+    for (const auto& documents : segment_top_documents) {
+        for (const Document& document : documents) {
+            top.Add(document);
+        }
+    }
+    return top.Extract();
+}
+
+// Поиск по набору серверов как по одному индексу: запрос с общими IDF
+// рассылается серверам (параллельно для parallel_policy), лучшие документы
+// серверов сливаются в общую выдачу. Каждый сервер ищет однопоточно.
+// document_predicate - предикат или DocumentStatus: статус передается серверам
+// как есть, и они отбирают документы по битовой карте статуса без предиката
+template <typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> FindTopDocumentsInSegments(
+    ExecutionPolicy&& policy,
+    ThreadPool* thread_pool,
+    const std::vector<const SearchServer*>& segments,
+    const PreparedQuery& query,
+    DocumentPredicate document_predicate,
+    const SearchOptions& options) {
+
+    const PreparedQuery global_query = WithGlobalStatistics(query, segments);
+    return MergeSegmentTopDocuments(policy, thread_pool, segments.size(), options.max_result_count, [&](size_t i) {
+        return segments[i]->FindTopDocuments(global_query, document_predicate, options);
+    });
+}
+
+// Индекс, разделенный на сегменты по номеру документа: документ id хранится
+// в сегменте id % GetSegmentCount(). Каждый сегмент - самостоятельный SearchServer
+// со своим словарем и списками документов, поэтому сегменты ищут независимо.
+//
+// Запрос рассылается всем сегментам (параллельно для parallel_policy) вместе
+// с IDF, посчитанными по всем сегментам сразу, и лучшие документы сегментов
+// сливаются в общую выдачу. Релевантность документа поэтому та же, что у одного
+// SearchServer со всеми документами
+class SegmentedSearchServer {
+public:
+    SegmentedSearchServer(std::string_view stop_words_text, size_t segment_count);
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void RemoveDocument(int document_id);
+
+    int GetDocumentCount() const;
+    size_t GetSegmentCount() const;
+    const SearchServer& GetSegment(size_t index) const;
+
+    // Пул потоков для рассылки запроса по сегментам
+    void SetThreadPool(std::shared_ptr<ThreadPool> thread_pool);
+
+    // Разобранный запрос подходит всем сегментам: стоп-слова у них общие
+    PreparedQuery PrepareQuery(std::string_view raw_query) const;
+
+    // Копия запроса с IDF плюс слов по всем сегментам
+    PreparedQuery WithGlobalStatistics(const PreparedQuery& query) const;
+
+    template <typename ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(
+        ExecutionPolicy&& policy,
+        const PreparedQuery& query,
+        DocumentPredicate document_predicate,
+        const SearchOptions& options) const;
+
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(
+        ExecutionPolicy&& policy,
+        const PreparedQuery& query,
+        DocumentStatus status,
+        const SearchOptions& options) const;
+
+    template <typename ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(
+        ExecutionPolicy&& policy,
+        std::string_view raw_query,
+        DocumentPredicate document_predicate,
+        const SearchOptions& options) const;
+
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(
+        ExecutionPolicy&& policy,
+        std::string_view raw_query,
+        DocumentStatus status = DocumentStatus::ACTUAL,
+        const SearchOptions& options = {}) const;
+
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(
+        ExecutionPolicy&& policy,
+        const PreparedQuery& query,
+        DocumentStatus status = DocumentStatus::ACTUAL) const;
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const;
+
+    // Поиск слов запроса в документе, в сегменте документа
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+
+private:
+    std::vector<SearchServer> segments_;
+    std::shared_ptr<ThreadPool> thread_pool_;
+
+    // Сегмент документа. Бросает out_of_range для отрицательного номера
+    size_t GetSegmentIndex(int document_id) const;
+
+    std::vector<const SearchServer*> GetSegmentPointers() const;
+};
+
+
+template <typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(
+    ExecutionPolicy&& policy,
+    const PreparedQuery& query,
+    DocumentPredicate document_predicate,
+    const SearchOptions& options) const {
+    return FindTopDocumentsInSegments(policy, thread_pool_.get(), GetSegmentPointers(), query, document_predicate, options);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(
+    ExecutionPolicy&& policy,
+    const PreparedQuery& query,
+    DocumentStatus status,
+    const SearchOptions& options) const {
+    return FindTopDocumentsInSegments(policy, thread_pool_.get(), GetSegmentPointers(), query, status, options);
+}
+
+template <typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(
+    ExecutionPolicy&& policy,
+    std::string_view raw_query,
+    DocumentPredicate document_predicate,
+    const SearchOptions& options) const {
+    return FindTopDocuments(policy, PrepareQuery(raw_query), document_predicate, options);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(
+    ExecutionPolicy&& policy,
+    std::string_view raw_query,
+    DocumentStatus status,
+    const SearchOptions& options) const {
+    return FindTopDocuments(policy, PrepareQuery(raw_query), status, options);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(
+    ExecutionPolicy&& policy,
+    const PreparedQuery& query,
+    DocumentStatus status) const {
+    return FindTopDocuments(policy, query, status, SearchOptions{});
+}
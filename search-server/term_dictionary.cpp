@@ -0,0 +1,64 @@
+#include "term_dictionary.h"
+
+#include <atomic>
+
+using namespace std;
+
+namespace {
+
+uint64_t GenerateDictionaryUid() {
+    static atomic<uint64_t> next_uid{ 1 };
+    return next_uid.fetch_add(1, memory_order_relaxed);
+}
+
+} // namespace
+
+TermDictionary::TermDictionary()
+    : uid_(GenerateDictionaryUid()) {
+}
+
+TermDictionary::TermDictionary(const TermDictionary& other)
+    : uid_(GenerateDictionaryUid())
+    , words_(other.words_)
+    , word_to_term_id_(other.word_to_term_id_) {
+}
+
+TermDictionary& TermDictionary::operator=(const TermDictionary& other) {
+    if (this != &other) {
+        uid_ = GenerateDictionaryUid();
+        words_ = other.words_;
+        word_to_term_id_ = other.word_to_term_id_;
+    }
+    return *this;
+}
+
+int TermDictionary::AddTerm(string_view word) {
+    // Для уже известного слова строка не создается
+    auto it = word_to_term_id_.find(word);
+    if (it != word_to_term_id_.end()) {
+        return it->second;
+    }
+
+    // Новое слово получает следующий свободный номер
+    const int term_id = static_cast<int>(words_.size());
+    words_.push_back(make_shared<const string>(word));
+    word_to_term_id_.emplace(*words_.back(), term_id);
+    return term_id;
+}
+
+int TermDictionary::FindTerm(string_view word) const {
+    auto it = word_to_term_id_.find(word);
+    return it == word_to_term_id_.end() ? NO_TERM : it->second;
+}
+
+string_view TermDictionary::GetWord(int term_id) const {
+    return *words_[term_id];
+}
+
+int TermDictionary::GetTermCount() const {
+    return static_cast<int>(words_.size());
+}
+
+uint64_t TermDictionary::GetUid() const {
+    return uid_;
+}
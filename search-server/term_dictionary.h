@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Словарь терминов: каждому уникальному слову выдается плотный номер (term id)
+// в порядке добавления. Номера не переиспользуются, поэтому их можно хранить
+// в индексах и кэшах на всё время жизни сервера.
+//
+// Строки слов неизменяемы и хранятся в shared_ptr: адреса не меняются при росте
+// словаря и остаются валидными в копиях сервера. Хеш-таблица ключуется
+// string_view на эти строки, поэтому поиск по string_view из запроса не создает
+// временных std::string и выполняется одним обращением к таблице
+class TermDictionary {
+public:
+    // Значение, возвращаемое при отсутствии слова в словаре
+    static const int NO_TERM = -1;
+
+    TermDictionary();
+
+    // Копия получает собственный идентификатор: после копирования словари
+    // расходятся и могут выдать одинаковые номера разным словам
+    TermDictionary(const TermDictionary& other);
+    TermDictionary& operator=(const TermDictionary& other);
+
+    // Возвращает номер слова, добавляя его в словарь при необходимости
+    int AddTerm(std::string_view word);
+
+    // Возвращает номер слова или NO_TERM, если слова нет
+    int FindTerm(std::string_view word) const;
+
+    // Слово по его номеру. Указатель остается валидным, пока жив словарь или его копия
+    std::string_view GetWord(int term_id) const;
+
+    // Количество слов в словаре
+    int GetTermCount() const;
+
+    // Идентификатор словаря, уникальный в пределах процесса. Номера слов,
+    // полученные от словаря с тем же идентификатором, остаются верными
+    uint64_t GetUid() const;
+
+private:
+    uint64_t uid_;
+
+    // Строки слов по номеру. Копии словаря разделяют одни и те же строки
+    std::vector<std::shared_ptr<const std::string>> words_;
+
+    // Слово (указывает на строку из words_) и его номер
+    std::unordered_map<std::string_view, int> word_to_term_id_;
+};
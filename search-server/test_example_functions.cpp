@@ -2,13 +2,29 @@
 
 #include "test_example_functions.h"
 #include "remove_duplicates.h"
-
+#include "concurrent_map.h"
+#include "document_bitmap.h"
+#include "lsm_search_server.h"
+#include "posting_codec.h"
+#include "process_queries.h"
+#include "score_accumulator.h"
+#include "segmented_search_server.h"
+#include "thread_pool.h"
+
+#include <atomic>
 #include <iostream>
 #include <numeric>
 #include <cmath>
 #include <execution>
 #include <functional>
+#include <future>
+#include <limits>
 #include <string_view>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
 
 using namespace std;
 
@@ -475,6 +491,13 @@ void TestGetWordFrequencies() {
     map<string_view, double> right_answer{ {"cat"sv, 0.4}, { "fat"sv, 0.2 }, { "fluffy"sv, 0.2 }, { "house"sv, 0.2 } };
     ASSERT_EQUAL_HINT(answer, right_answer, "Incorrect word list or word frequency in the document");
 
+    //Слова копии сервера остаются валидными после уничтожения исходного сервера
+    auto original = make_unique<SearchServer>("in the"s);
+    original->AddDocument(doc_id, content, DocumentStatus::ACTUAL, ratings);
+    const SearchServer server_copy(*original);
+    original.reset();
+    ASSERT_EQUAL_HINT(server_copy.GetWordFrequencies(42), right_answer, "Copied server lost its words");
+
 }
 
 //Тест проверяет, что поисковая система корректно удаляет документ по id
@@ -608,6 +631,1400 @@ void TestRemoveDuplicate() {
     ASSERT_EQUAL_HINT(answer, right_answer, "Incorrect id list");
 }
 
+//Тест проверяет, что добавления и удаления, накопленные в буфере записи индекса,
+//корректно применяются в любом порядке
+void TestIndexWriteBuffer() {
+    SearchServer server("in the"s);
+    server.AddDocument(1, "cat in the city"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "dog in the city"s, DocumentStatus::ACTUAL, { 2 });
+
+    //Поиск вливает буфер в индекс
+    ASSERT_EQUAL(server.FindTopDocuments("city"s).size(), 2u);
+
+    //Добавление документа с меньшим номером после слияния сохраняет сортировку списков
+    server.AddDocument(0, "bird in the city"s, DocumentStatus::ACTUAL, { 3 });
+    ASSERT_EQUAL(server.FindTopDocuments("city"s).size(), 3u);
+    {
+        const auto [matched_words, status] = server.MatchDocument("bird city", 0);
+        vector<string_view> right_answer = { "bird"sv, "city"sv };
+        ASSERT_EQUAL(matched_words, right_answer);
+    }
+
+    //Удаление и повторное добавление документа с тем же номером до слияния
+    server.RemoveDocument(1);
+    server.AddDocument(1, "fox in the forest"s, DocumentStatus::ACTUAL, { 4 });
+    ASSERT_EQUAL(server.FindTopDocuments("city"s).size(), 2u);
+    {
+        const auto found_docs = server.FindTopDocuments("fox cat"s);
+        ASSERT_EQUAL(found_docs.size(), 1u);
+        ASSERT_EQUAL(found_docs[0].id, 1);
+        ASSERT_EQUAL(found_docs[0].rating, 4);
+    }
+
+    //Копия сервера содержит все накопленные изменения
+    server.RemoveDocument(2);
+    SearchServer copy = server;
+    ASSERT_EQUAL(copy.FindTopDocuments("city"s).size(), 1u);
+    ASSERT_HINT(copy.FindTopDocuments("dog"s).empty(), "Removed document should not be found"s);
+}
+
+//Тест проверяет, что кодек StreamVByte и разностное кодирование восстанавливают исходные значения
+void TestPostingCodec() {
+    mt19937 generator;
+
+    //Проверяем длины, не кратные группе из 4 значений, и значения всех байтовых длин
+    for (size_t count : { 0u, 1u, 3u, 4u, 5u, 127u, 128u, 1000u }) {
+        vector<uint32_t> values(count);
+        for (auto& value : values) {
+            const int bits = uniform_int_distribution(0, 32)(generator);
+            value = bits == 0 ? 0 : static_cast<uint32_t>(generator()) >> (32 - bits);
+        }
+
+        vector<uint8_t> encoded;
+        EncodeStreamVByte(values.data(), values.size(), encoded);
+        const size_t encoded_size = encoded.size();
+        encoded.resize(encoded_size + STREAM_VBYTE_PADDING);
+
+        vector<uint32_t> decoded(count);
+        const uint8_t* end = DecodeStreamVByte(encoded.data(), count, decoded.data());
+        ASSERT_EQUAL_HINT(decoded, values, "StreamVByte round trip failed"s);
+        ASSERT_EQUAL_HINT(static_cast<size_t>(end - encoded.data()), encoded_size, "Decoder consumed wrong number of bytes"s);
+
+        vector<uint32_t> decoded_scalar(count);
+        DecodeStreamVByteScalar(encoded.data(), count, decoded_scalar.data());
+        ASSERT_EQUAL_HINT(decoded_scalar, values, "Scalar StreamVByte round trip failed"s);
+    }
+
+    //Разностное кодирование возрастающей последовательности
+    {
+        vector<uint32_t> ordinals;
+        uint32_t ordinal = 17;
+        for (int i = 0; i < 301; ++i) {
+            ordinal += uniform_int_distribution(1, 1000)(generator);
+            ordinals.push_back(ordinal);
+        }
+        vector<uint32_t> deltas = ordinals;
+        EncodeDeltas(deltas.data(), deltas.size(), 17);
+        DecodeDeltas(deltas.data(), deltas.size(), 17);
+        ASSERT_EQUAL_HINT(deltas, ordinals, "Delta round trip failed"s);
+    }
+}
+
+//Тест проверяет, что сжатый формат индекса дает те же результаты, что и несжатый
+void TestCompressedPostingFormat() {
+    SearchServer server("and in the"s);
+
+    //Документов больше размера блока, чтобы списки занимали несколько блоков
+    for (int id = 0; id < 300; ++id) {
+        const string text = (id % 2 == 0 ? "cat "s : "dog "s) + (id % 3 == 0 ? "city city "s : "village "s) + "in the house"s;
+        server.AddDocument(id * 2, text, DocumentStatus::ACTUAL, { id });
+    }
+    server.RemoveDocument(10);
+
+    const auto raw_docs = server.FindTopDocuments("cat city -village"s);
+    const auto [raw_words, raw_status] = server.MatchDocument("cat city house", 12);
+
+    server.SetPostingFormat(PostingFormat::COMPRESSED);
+    ASSERT(server.GetPostingFormat() == PostingFormat::COMPRESSED);
+
+    const auto compressed_docs = server.FindTopDocuments("cat city -village"s);
+    ASSERT_EQUAL(compressed_docs.size(), raw_docs.size());
+    for (size_t i = 0; i < raw_docs.size(); ++i) {
+        ASSERT_EQUAL(compressed_docs[i].id, raw_docs[i].id);
+        ASSERT_EQUAL(compressed_docs[i].relevance, raw_docs[i].relevance);
+    }
+    const auto [compressed_words, compressed_status] = server.MatchDocument("cat city house", 12);
+    ASSERT_EQUAL(compressed_words, raw_words);
+
+    //Добавление и удаление работают поверх сжатого индекса
+    server.RemoveDocument(12);
+    server.AddDocument(1000, "unique cat"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(server.FindTopDocuments("unique"s).size(), 1u);
+    ASSERT_EQUAL(server.FindTopDocuments(execution::par, "city"s).size(), 5u);
+    ASSERT_HINT(!get<0>(server.MatchDocument("cat", 1000)).empty(), "Document should match"s);
+
+    //Обратное переключение формата
+    server.SetPostingFormat(PostingFormat::RAW);
+    ASSERT_EQUAL(server.FindTopDocuments("unique"s).size(), 1u);
+}
+
+//Тест проверяет, что закэшированный IDF пересчитывается после добавления и удаления документов
+void TestInverseDocumentFreqCache() {
+    SearchServer server(""s);
+    server.AddDocument(1, "cat in the city"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "black dog"s, DocumentStatus::ACTUAL, { 1 });
+
+    auto check_relevance = [&server](double expected_relevance) {
+        const auto found_docs = server.FindTopDocuments("black"s);
+        ASSERT_EQUAL(found_docs.size(), 1u);
+        ASSERT_HINT(abs(found_docs[0].relevance - expected_relevance) < 1e-9, "Stale inverse document frequency"s);
+    };
+
+    check_relevance(0.5 * log(2.0));
+
+    server.AddDocument(3, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(4, "white dog"s, DocumentStatus::ACTUAL, { 1 });
+    check_relevance(0.5 * log(4.0));
+
+    server.RemoveDocument(execution::par, 3);
+    check_relevance(0.5 * log(3.0));
+}
+
+void TestResultCount() {
+    SearchServer server(""s);
+    // 20 документов: релевантность растет с номером, у пар с равной
+    // релевантностью рейтинг больше у документа с меньшим номером
+    for (int id = 0; id < 20; ++id) {
+        string text = "cat"s;
+        for (int i = 0; i < id / 2; ++i) {
+            text += " cat"s;
+        }
+        text += " dog"s;
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, { 100 - id });
+    }
+    server.AddDocument(20, "bird"s, DocumentStatus::ACTUAL, { 1 });
+
+    // По умолчанию выдача ограничена MAX_RESULT_DOCUMENT_COUNT
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+
+    auto all_docs = server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, SearchOptions{ 100 });
+    ASSERT_EQUAL(all_docs.size(), 20u);
+    for (size_t i = 1; i < all_docs.size(); ++i) {
+        ASSERT_HINT(IsMoreRelevant(all_docs[i - 1], all_docs[i]), "Wrong order of documents"s);
+    }
+    ASSERT_EQUAL(all_docs[0].id, 18);
+    ASSERT_EQUAL(all_docs[1].id, 19);
+
+    // Первые K документов совпадают с началом полной выдачи во всех версиях
+    for (size_t count : { 0u, 1u, 7u, 20u }) {
+        const SearchOptions options{ count };
+        const vector<Document> expected(all_docs.begin(), all_docs.begin() + count);
+        const auto check = [&expected](const vector<Document>& found_docs) {
+            ASSERT_EQUAL(found_docs.size(), expected.size());
+            for (size_t i = 0; i < found_docs.size(); ++i) {
+                ASSERT_EQUAL(found_docs[i].id, expected[i].id);
+            }
+        };
+        check(server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, options));
+        check(server.FindTopDocuments(execution::seq, "cat"s, DocumentStatus::ACTUAL, options));
+        check(server.FindTopDocuments(execution::par, "cat"s, DocumentStatus::ACTUAL, options));
+        check(server.FindTopDocuments("cat"s,
+            [](int document_id, DocumentStatus status, int rating) { return true; }, options));
+    }
+
+    // K намного больше корпуса: выдача - все найденные документы, память под K
+    // документов не выделяется
+    for (const size_t count : { static_cast<size_t>(1'000'000'000), numeric_limits<size_t>::max() }) {
+        for (const auto evaluation : { EvaluationMode::EXHAUSTIVE, EvaluationMode::MAX_SCORE, EvaluationMode::BLOCK_MAX_SCORE }) {
+            const SearchOptions options{ count, evaluation };
+            ASSERT_EQUAL(server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, options).size(), 20u);
+            ASSERT_EQUAL(server.FindTopDocuments(execution::par, "cat"s, DocumentStatus::ACTUAL, options).size(), 20u);
+        }
+        const auto batch = server.FindTopDocumentsBatch(execution::par, { server.PrepareQuery("cat"s) },
+            DocumentStatus::ACTUAL, SearchOptions{ count });
+        ASSERT_EQUAL(batch.front().size(), 20u);
+    }
+}
+
+void TestPrunedEvaluation() {
+    // Случайный корпус с частотами слов по закону Ципфа
+    mt19937 generator(42);
+    vector<string> words;
+    vector<double> weights;
+    for (int i = 0; i < 300; ++i) {
+        words.push_back("w"s + to_string(i));
+        weights.push_back(1.0 / (i + 1));
+    }
+    discrete_distribution<int> word_distribution(weights.begin(), weights.end());
+    auto generate_text = [&](int word_count, double minus_prob) {
+        string text;
+        for (int i = 0; i < word_count; ++i) {
+            if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
+                text += "-"s;
+            }
+            text += words[word_distribution(generator)] + " "s;
+        }
+        return text;
+    };
+
+    SearchServer server("w0"s);
+    for (int id = 0; id < 2000; ++id) {
+        const auto status = id % 7 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+        server.AddDocument(id, generate_text(uniform_int_distribution(1, 40)(generator), 0.0), status, { id % 11 - 5 });
+    }
+    for (int id = 0; id < 2000; id += 13) {
+        server.RemoveDocument(id);
+    }
+
+    const auto even_ids = [](int document_id, DocumentStatus status, int rating) { return document_id % 2 == 0; };
+    const auto check = [](const vector<Document>& expected, const vector<Document>& found_docs) {
+        ASSERT_EQUAL(found_docs.size(), expected.size());
+        for (size_t j = 0; j < found_docs.size(); ++j) {
+            ASSERT_EQUAL(found_docs[j].id, expected[j].id);
+            ASSERT_HINT(found_docs[j].relevance == expected[j].relevance, "Pruned relevance differs"s);
+        }
+    };
+    for (const PostingFormat format : { PostingFormat::RAW, PostingFormat::COMPRESSED }) {
+        server.SetPostingFormat(format);
+        for (size_t block_size : { 1u, 4u, 64u }) {
+            server.SetScoreBlockSize(block_size);
+            for (int i = 0; i < 50; ++i) {
+                const string query = generate_text(uniform_int_distribution(1, 30)(generator), 0.1);
+                for (size_t count : { 1u, 5u, 50u }) {
+                    const SearchOptions exhaustive{ count, EvaluationMode::EXHAUSTIVE };
+                    for (const EvaluationMode mode : { EvaluationMode::MAX_SCORE, EvaluationMode::BLOCK_MAX_SCORE }) {
+                        const SearchOptions pruned{ count, mode };
+                        check(server.FindTopDocuments(query, DocumentStatus::ACTUAL, exhaustive),
+                            server.FindTopDocuments(query, DocumentStatus::ACTUAL, pruned));
+                        check(server.FindTopDocuments(query, even_ids, exhaustive),
+                            server.FindTopDocuments(query, even_ids, pruned));
+                    }
+                }
+            }
+        }
+    }
+}
+
+void TestScoreAccumulator() {
+    ScoreAccumulator accumulator;
+    accumulator.Reset(10);
+    accumulator.Add(7, 1.0);
+    accumulator.Add(2, 0.5);
+    accumulator.Add(7, 0.25);
+
+    ASSERT(accumulator.GetTouched() == vector<int>({ 2, 7 }));
+    ASSERT(accumulator.IsScored(7));
+    ASSERT(!accumulator.IsScored(5));
+    ASSERT_EQUAL(accumulator.GetScore(7), 1.25);
+
+    // Сброс забывает прошлый запрос и расширяет массивы под выросший индекс
+    accumulator.Reset(20);
+    ASSERT(accumulator.GetTouched().empty());
+    ASSERT(!accumulator.IsScored(7));
+    accumulator.Add(15, 2.0);
+    accumulator.Add(7, 3.0);
+    ASSERT(accumulator.GetTouched() == vector<int>({ 7, 15 }));
+    ASSERT_EQUAL(accumulator.GetScore(7), 3.0);
+}
+
+void TestParallelSearchRanges() {
+    // Документов достаточно, чтобы параллельный поиск разбил их на несколько диапазонов
+    mt19937 generator(7);
+    auto generate_text = [&generator](int word_count, double minus_prob) {
+        string text;
+        for (int i = 0; i < word_count; ++i) {
+            if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
+                text += "-"s;
+            }
+            text += "w"s + to_string(uniform_int_distribution(0, 200)(generator)) + " "s;
+        }
+        return text;
+    };
+
+    SearchServer server(""s);
+    for (int id = 0; id < 10000; ++id) {
+        server.AddDocument(id, generate_text(uniform_int_distribution(1, 20)(generator), 0.0), DocumentStatus::ACTUAL, { id });
+    }
+    for (int id = 0; id < 10000; id += 3) {
+        server.RemoveDocument(id);
+    }
+
+    const auto odd_ids = [](int document_id, DocumentStatus status, int rating) { return document_id % 2 == 1; };
+    for (int i = 0; i < 20; ++i) {
+        const string query = generate_text(10, 0.2);
+        for (size_t count : { 5u, 50u }) {
+            const SearchOptions options{ count };
+            const auto expected = server.FindTopDocuments(query, odd_ids, options);
+            const auto found_docs = server.FindTopDocuments(execution::par, query, odd_ids, options);
+            ASSERT_EQUAL(found_docs.size(), expected.size());
+            for (size_t j = 0; j < found_docs.size(); ++j) {
+                ASSERT_EQUAL(found_docs[j].id, expected[j].id);
+                ASSERT_EQUAL(found_docs[j].relevance, expected[j].relevance);
+            }
+        }
+    }
+}
+
+void TestConcurrentMap() {
+    // Одновременное прибавление из нескольких потоков: атомарный путь и путь через Access
+    ConcurrentMap<int, long long> counters(7);
+    ConcurrentMap<int, double> sums(3);
+    vector<thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&counters, &sums]() {
+            for (int i = 0; i < 20000; ++i) {
+                counters.FetchAdd(i % 1000, 1);
+                sums.FetchAdd(-(i % 100), 0.5);
+                counters[1000 + i % 10].ref_to_value += 2;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto drained = counters.Drain();
+    ASSERT_EQUAL(drained.size(), 1010u);
+    sort(drained.begin(), drained.end());
+    for (int key = 0; key < 1000; ++key) {
+        ASSERT_EQUAL(drained[key].first, key);
+        ASSERT_EQUAL(drained[key].second, 80);
+    }
+    for (int key = 1000; key < 1010; ++key) {
+        ASSERT_EQUAL(drained[key].second, 16000);
+    }
+
+    const auto drained_sums = sums.Drain();
+    ASSERT_EQUAL(drained_sums.size(), 100u);
+    for (const auto& [key, sum] : drained_sums) {
+        ASSERT(key <= 0 && key > -100);
+        ASSERT_EQUAL(sum, 400.0);
+    }
+
+    // После Drain словарь пуст и снова пригоден к работе
+    ASSERT(counters.Drain().empty());
+    ConcurrentMap<int, string> words(2);
+    words[5].ref_to_value = "five"s;
+    words[5].ref_to_value += "!"s;
+    const auto drained_words = words.Drain();
+    ASSERT_EQUAL(drained_words.size(), 1u);
+    ASSERT_EQUAL(drained_words[0].second, "five!"s);
+}
+
+void TestDocumentBitmap() {
+    // Фрагмент 0 - массив, фрагмент 1 - битовая карта, фрагмент 3 - одиночный номер
+    vector<int> sparse;
+    for (int ordinal = 0; ordinal < 65536; ordinal += 100) {
+        sparse.push_back(ordinal);
+    }
+    vector<int> dense;
+    for (int ordinal = 65536; ordinal < 2 * 65536; ordinal += 3) {
+        dense.push_back(ordinal);
+    }
+
+    DocumentBitmap bitmap;
+    bitmap.AddSorted(sparse.data(), sparse.size());
+    DocumentBitmap other;
+    other.AddSorted(dense.data(), dense.size());
+    other.Add(3 * 65536 + 5);
+    other.Add(50);
+    bitmap |= other;
+
+    ASSERT_EQUAL(bitmap.GetCardinality(), sparse.size() + dense.size() + 2);
+    for (int ordinal = 0; ordinal < 4 * 65536; ++ordinal) {
+        const bool expected = (ordinal < 65536 && (ordinal % 100 == 0 || ordinal == 50))
+            || (ordinal >= 65536 && ordinal < 2 * 65536 && (ordinal - 65536) % 3 == 0)
+            || ordinal == 3 * 65536 + 5;
+        ASSERT_EQUAL(bitmap.Contains(ordinal), expected);
+    }
+
+    // Удаление из битовой карты до перехода обратно в массив
+    for (const int ordinal : dense) {
+        bitmap.Remove(ordinal);
+    }
+    bitmap.Remove(50);
+    ASSERT_EQUAL(bitmap.GetCardinality(), sparse.size() + 1);
+    ASSERT(!bitmap.Contains(65536));
+    ASSERT(bitmap.Contains(3 * 65536 + 5));
+    ASSERT(DocumentBitmap().IsEmpty());
+}
+
+void TestStatusFastPath() {
+    SearchServer server(""s);
+    const vector<DocumentStatus> statuses = {
+        DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED, DocumentStatus::REMOVED };
+    for (int id = 0; id < 200; ++id) {
+        server.AddDocument(id, "cat dog"s + string(id % 5, 'x') + (id % 3 == 0 ? " cat"s : " bird"s), statuses[id % 4], { id });
+    }
+    for (int id = 0; id < 200; id += 7) {
+        server.RemoveDocument(id);
+    }
+
+    for (const DocumentStatus status : statuses) {
+        const auto by_lambda = [status](int document_id, DocumentStatus document_status, int rating) {
+            return document_status == status;
+        };
+        for (const EvaluationMode mode : { EvaluationMode::EXHAUSTIVE, EvaluationMode::MAX_SCORE }) {
+            const SearchOptions options{ 100, mode };
+            const auto expected = server.FindTopDocuments("cat -bird"s, by_lambda, options);
+            ASSERT(!expected.empty());
+            for (const auto& found_docs : {
+                server.FindTopDocuments("cat -bird"s, status, options),
+                server.FindTopDocuments(execution::par, "cat -bird"s, status, options) }) {
+                ASSERT_EQUAL(found_docs.size(), expected.size());
+                for (size_t i = 0; i < found_docs.size(); ++i) {
+                    ASSERT_EQUAL(found_docs[i].id, expected[i].id);
+                    ASSERT_HINT(found_docs[i].id % 7 != 0, "Removed document found by status"s);
+                    ASSERT_EQUAL(static_cast<int>(statuses[found_docs[i].id % 4]), static_cast<int>(status));
+                }
+            }
+        }
+    }
+}
+
+void TestPreparedQuery() {
+    const vector<string> texts = {
+        "white cat and fashionable collar"s,
+        "fluffy cat fluffy tail"s,
+        "groomed dog expressive eyes"s,
+        "groomed starling eugene"s,
+        "fluffy dog and white collar"s,
+    };
+    SearchServer server("and in"s);
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, { id });
+    }
+
+    auto assert_same_documents = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        ASSERT_EQUAL(lhs.size(), rhs.size());
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            ASSERT_EQUAL(lhs[i].id, rhs[i].id);
+            ASSERT_EQUAL(lhs[i].relevance, rhs[i].relevance);
+        }
+    };
+
+    // Повторы и стоп-слова отбрасываются при подготовке
+    const string raw_query = "fluffy groomed cat fluffy and -collar -collar"s;
+    const PreparedQuery query = server.PrepareQuery(raw_query);
+    ASSERT(query.GetPlusWords() == vector<string>({ "cat"s, "fluffy"s, "groomed"s }));
+    ASSERT(query.GetMinusWords() == vector<string>({ "collar"s }));
+
+    // Разобранный запрос дает ту же выдачу, что и строка, при многократном использовании
+    for (int i = 0; i < 2; ++i) {
+        const SearchOptions options{ 3, EvaluationMode::MAX_SCORE };
+        assert_same_documents(server.FindTopDocuments(query), server.FindTopDocuments(raw_query));
+        assert_same_documents(server.FindTopDocuments(execution::seq, query), server.FindTopDocuments(raw_query));
+        assert_same_documents(server.FindTopDocuments(execution::par, query), server.FindTopDocuments(execution::par, raw_query));
+        assert_same_documents(server.FindTopDocuments(query, DocumentStatus::ACTUAL, options),
+            server.FindTopDocuments(raw_query, DocumentStatus::ACTUAL, options));
+        assert_same_documents(
+            server.FindTopDocuments(execution::par, query, [](int id, DocumentStatus, int) { return id % 2 == 1; }),
+            server.FindTopDocuments(execution::par, raw_query, [](int id, DocumentStatus, int) { return id % 2 == 1; }));
+    }
+
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        const auto [words, status] = server.MatchDocument(query, id);
+        ASSERT(words == get<0>(server.MatchDocument(raw_query, id)));
+        ASSERT(words == get<0>(server.MatchDocument(execution::par, query, id)));
+    }
+
+    // Найденные слова не зависят от строки и времени жизни запроса
+    vector<string_view> matched_words;
+    {
+        const PreparedQuery temporary_query = server.PrepareQuery("eyes dog"s);
+        matched_words = get<0>(server.MatchDocument(temporary_query, 2));
+    }
+    ASSERT(matched_words == vector<string_view>({ "dog"sv, "eyes"sv }));
+
+    // Слово, которого не было в словаре при подготовке, находится после добавления документа
+    const PreparedQuery new_word_query = server.PrepareQuery("parrot"s);
+    ASSERT(server.FindTopDocuments(new_word_query).empty());
+    server.AddDocument(10, "green parrot"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(server.FindTopDocuments(new_word_query).size(), 1u);
+
+    // Запрос подходит для другого сервера с другими номерами слов
+    SearchServer other_server("and in"s);
+    other_server.AddDocument(1, "groomed collar"s, DocumentStatus::ACTUAL, { 1 });
+    other_server.AddDocument(2, "fluffy groomed cat"s, DocumentStatus::ACTUAL, { 1 });
+    assert_same_documents(other_server.FindTopDocuments(query), other_server.FindTopDocuments(raw_query));
+    assert_same_documents(other_server.FindTopDocuments(execution::par, query), other_server.FindTopDocuments(raw_query));
+    ASSERT(get<0>(other_server.MatchDocument(query, 2)) == vector<string_view>({ "cat"sv, "fluffy"sv, "groomed"sv }));
+
+    // Недопустимый запрос отклоняется при подготовке
+    bool is_rejected = false;
+    try {
+        server.PrepareQuery("cat --dog"s);
+    }
+    catch (const invalid_argument&) {
+        is_rejected = true;
+    }
+    ASSERT(is_rejected);
+}
+
+void TestMatchDocuments() {
+    SearchServer server("and in"s);
+    mt19937 generator(15);
+    const vector<string> words = { "cat"s, "dog"s, "bird"s, "tail"s, "collar"s, "eyes"s };
+    for (int id = 0; id < 3000; ++id) {
+        string text;
+        for (int i = 0; i < 4; ++i) {
+            text += words[generator() % words.size()] + " "s;
+        }
+        server.AddDocument(id * 2, text, DocumentStatus::ACTUAL, { id });
+    }
+    server.RemoveDocument(10);
+
+    // Повторы, произвольный порядок и несуществующее в словаре слово
+    vector<int> document_ids;
+    for (int i = 0; i < 500; ++i) {
+        document_ids.push_back(static_cast<int>(generator() % 3000) * 2);
+    }
+    document_ids.push_back(document_ids.front());
+
+    for (const string& raw_query : { "cat tail eyes parrot -collar"s, "dog bird"s, "-cat"s, "parrot"s }) {
+        const PreparedQuery query = server.PrepareQuery(raw_query);
+        for (const auto& matches : {
+            server.MatchDocuments(raw_query, document_ids),
+            server.MatchDocuments(execution::seq, query, document_ids),
+            server.MatchDocuments(execution::par, raw_query, document_ids) }) {
+            ASSERT_EQUAL(matches.GetDocumentCount(), document_ids.size());
+            for (size_t i = 0; i < document_ids.size(); ++i) {
+                const auto [expected_words, expected_status] = server.MatchDocument(query, document_ids[i]);
+                ASSERT(matches.GetWords(i) == expected_words);
+                ASSERT(matches.statuses[i] == expected_status);
+            }
+        }
+    }
+
+    ASSERT_EQUAL(server.MatchDocuments("cat"s, {}).GetDocumentCount(), 0u);
+
+    // Удаленный документ
+    bool is_rejected = false;
+    try {
+        server.MatchDocuments("cat"s, { 0, 10 });
+    }
+    catch (const out_of_range&) {
+        is_rejected = true;
+    }
+    ASSERT(is_rejected);
+}
+
+void TestBatchQueries() {
+    // Корпус и запросы с частыми общими словами (закон Ципфа)
+    mt19937 generator(16);
+    vector<string> words;
+    vector<double> weights;
+    for (int i = 0; i < 200; ++i) {
+        words.push_back("w"s + to_string(i));
+        weights.push_back(1.0 / (i + 1));
+    }
+    discrete_distribution<int> word_distribution(weights.begin(), weights.end());
+    auto generate_text = [&](int word_count, double minus_prob) {
+        string text;
+        for (int i = 0; i < word_count; ++i) {
+            if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
+                text += "-"s;
+            }
+            text += words[word_distribution(generator)] + " "s;
+        }
+        return text;
+    };
+
+    SearchServer server("w0"s);
+    const vector<DocumentStatus> statuses = { DocumentStatus::ACTUAL, DocumentStatus::ACTUAL, DocumentStatus::BANNED };
+    for (int id = 0; id < 3000; ++id) {
+        server.AddDocument(id, generate_text(uniform_int_distribution(1, 20)(generator), 0.0), statuses[id % 3], { id % 7 - 3 });
+    }
+    for (int id = 0; id < 3000; id += 11) {
+        server.RemoveDocument(id);
+    }
+
+    // Пустой запрос, запрос из неизвестного слова и повторяющиеся запросы
+    vector<string> raw_queries = { ""s, "unknown"s };
+    for (int i = 0; i < 100; ++i) {
+        raw_queries.push_back(generate_text(uniform_int_distribution(1, 8)(generator), 0.1));
+    }
+    raw_queries.push_back(raw_queries[5]);
+    vector<PreparedQuery> queries;
+    for (const string& raw_query : raw_queries) {
+        queries.push_back(server.PrepareQuery(raw_query));
+    }
+
+    const auto check = [](const vector<Document>& expected, const vector<Document>& found_docs) {
+        ASSERT_EQUAL(found_docs.size(), expected.size());
+        for (size_t j = 0; j < found_docs.size(); ++j) {
+            ASSERT_EQUAL(found_docs[j].id, expected[j].id);
+            ASSERT_HINT(found_docs[j].relevance == expected[j].relevance, "Batch relevance differs"s);
+            ASSERT_EQUAL(found_docs[j].rating, expected[j].rating);
+        }
+    };
+
+    for (const PostingFormat format : { PostingFormat::RAW, PostingFormat::COMPRESSED }) {
+        server.SetPostingFormat(format);
+        for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+            const SearchOptions options{ 20, EvaluationMode::EXHAUSTIVE };
+            const auto seq_results = server.FindTopDocumentsBatch(queries, status, options);
+            const auto par_results = server.FindTopDocumentsBatch(execution::par, queries, status, options);
+            ASSERT_EQUAL(seq_results.size(), queries.size());
+            ASSERT_EQUAL(par_results.size(), queries.size());
+            for (size_t i = 0; i < queries.size(); ++i) {
+                const auto expected = server.FindTopDocuments(raw_queries[i], status, options);
+                check(expected, seq_results[i]);
+                check(expected, par_results[i]);
+            }
+        }
+    }
+
+    const auto results = ProcessQueries(server, raw_queries);
+    for (size_t i = 0; i < raw_queries.size(); ++i) {
+        check(server.FindTopDocuments(raw_queries[i]), results[i]);
+    }
+    ASSERT(server.FindTopDocumentsBatch(vector<PreparedQuery>{}).empty());
+}
+
+void TestProcessQueriesJoined() {
+    SearchServer server("and with"s);
+    for (int id = 0; id < 100; ++id) {
+        server.AddDocument(id, "word"s + to_string(id % 10) + " common"s, DocumentStatus::ACTUAL, { id });
+    }
+
+    const vector<string> queries = { "word1"s, "unknown"s, "common -word2"s, ""s, "word3 word4"s };
+    const auto documents_lists = ProcessQueries(server, queries);
+    const JoinedDocuments joined = ProcessQueriesJoined(server, queries);
+
+    ASSERT_EQUAL(joined.GetQueryCount(), queries.size());
+    size_t total_count = 0;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const auto query_documents = joined.GetQueryDocuments(i);
+        ASSERT_EQUAL(query_documents.size(), documents_lists[i].size());
+        auto it = query_documents.begin();
+        for (const Document& document : documents_lists[i]) {
+            ASSERT_EQUAL(it->id, document.id);
+            ASSERT_EQUAL(it->relevance, document.relevance);
+            ++it;
+        }
+        total_count += documents_lists[i].size();
+    }
+
+    // Сквозной обход - в порядке запросов
+    ASSERT_EQUAL(joined.size(), total_count);
+    auto it = joined.begin();
+    for (const auto& documents : documents_lists) {
+        for (const Document& document : documents) {
+            ASSERT_EQUAL(it->id, document.id);
+            ++it;
+        }
+    }
+    ASSERT(it == joined.end());
+
+    ASSERT(ProcessQueriesJoined(server, {}).empty());
+
+    // С пулом потоков сервера результат тот же
+    server.SetThreadPool(make_shared<ThreadPool>(3));
+    const JoinedDocuments pool_joined = ProcessQueriesJoined(server, queries);
+    ASSERT_EQUAL(pool_joined.size(), joined.size());
+    ASSERT(equal(pool_joined.begin(), pool_joined.end(), joined.begin(), [](const Document& lhs, const Document& rhs) {
+        return lhs.id == rhs.id && lhs.relevance == rhs.relevance;
+    }));
+}
+
+void TestThreadPool() {
+    ThreadPool pool(4, true);
+    ASSERT_EQUAL(pool.GetThreadCount(), 4u);
+    ASSERT_EQUAL(pool.GetCurrentWorkerIndex(), ThreadPool::NO_WORKER);
+
+    // Каждый индекс обрабатывается ровно один раз, задачи выполняют рабочие потоки пула
+    const size_t count = 10000;
+    vector<atomic<int>> visits(count);
+    atomic<size_t> bad_worker_indices{ 0 };
+    pool.ParallelFor(count, [&](size_t i) {
+        ++visits[i];
+        const size_t worker_index = pool.GetCurrentWorkerIndex();
+        if (worker_index != ThreadPool::NO_WORKER && worker_index >= pool.GetThreadCount()) {
+            ++bad_worker_indices;
+        }
+    }, 16);
+    ASSERT(all_of(visits.begin(), visits.end(), [](const atomic<int>& visit) { return visit == 1; }));
+    ASSERT_EQUAL(bad_worker_indices.load(), 0u);
+
+    // Вложенный вызов из задачи пула не блокирует пул
+    atomic<size_t> nested_sum{ 0 };
+    pool.ParallelFor(8, [&](size_t i) {
+        pool.ParallelFor(100, [&](size_t j) { nested_sum += j; }, 10);
+    }, 1);
+    ASSERT_EQUAL(nested_sum.load(), 8u * 4950u);
+
+    // Исключение из задачи пробрасывается вызывающему
+    bool is_thrown = false;
+    try {
+        pool.ParallelFor(100, [](size_t i) {
+            if (i == 42) {
+                throw runtime_error("task failed"s);
+            }
+        }, 1);
+    }
+    catch (const runtime_error&) {
+        is_thrown = true;
+    }
+    ASSERT(is_thrown);
+
+    // Поставленные задачи выполняются до разрушения пула
+    atomic<int> submitted{ 0 };
+    {
+        ThreadPool short_lived_pool(2);
+        for (int i = 0; i < 100; ++i) {
+            short_lived_pool.Submit([&submitted] { ++submitted; });
+        }
+    }
+    ASSERT_EQUAL(submitted.load(), 100);
+
+    // Исключение из поставленной задачи попадает в ее future и не останавливает поток
+    {
+        ThreadPool single_pool(1);
+        future<void> failed = single_pool.Submit([] { throw runtime_error("task failed"s); });
+        bool is_submit_thrown = false;
+        try {
+            failed.get();
+        }
+        catch (const runtime_error&) {
+            is_submit_thrown = true;
+        }
+        ASSERT(is_submit_thrown);
+        atomic<int> after_failure{ 0 };
+        single_pool.Submit([&after_failure] { ++after_failure; }).get();
+        ASSERT_EQUAL(after_failure.load(), 1);
+    }
+
+    // Параллельные версии сервера на пуле дают ту же выдачу
+    SearchServer server("and with"s);
+    mt19937 generator(18);
+    for (int id = 0; id < 5000; ++id) {
+        server.AddDocument(id, "w"s + to_string(generator() % 50) + " w"s + to_string(generator() % 50) + " w"s + to_string(generator() % 7),
+            DocumentStatus::ACTUAL, { id });
+    }
+    const vector<string> queries = { "w1 w2 -w3"s, "w4 w40 w6"s, "w0"s, "w11 -w5 w49"s };
+    const auto expected = ProcessQueries(server, queries);
+    vector<vector<tuple<vector<string_view>, DocumentStatus>>> expected_matches;
+    for (const string& query : queries) {
+        expected_matches.emplace_back();
+        for (int id = 0; id < 50; ++id) {
+            expected_matches.back().push_back(server.MatchDocument(query, id));
+        }
+    }
+
+    server.SetThreadPool(make_shared<ThreadPool>(3));
+    const auto pooled = ProcessQueries(server, queries);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const auto found_docs = server.FindTopDocuments(execution::par, queries[i]);
+        ASSERT_EQUAL(found_docs.size(), expected[i].size());
+        ASSERT_EQUAL(pooled[i].size(), expected[i].size());
+        for (size_t j = 0; j < found_docs.size(); ++j) {
+            ASSERT_EQUAL(found_docs[j].id, expected[i][j].id);
+            ASSERT_EQUAL(pooled[i][j].id, expected[i][j].id);
+        }
+        for (int id = 0; id < 50; ++id) {
+            ASSERT(server.MatchDocument(execution::par, queries[i], id) == expected_matches[i][id]);
+        }
+    }
+}
+
+void TestSegmentedIndex() {
+    // Документы со случайными словами, у каждого документа свой рейтинг
+    mt19937 generator(19);
+    vector<string> documents;
+    for (int id = 0; id < 3000; ++id) {
+        documents.push_back("w"s + to_string(generator() % 40) + " w"s + to_string(generator() % 40)
+            + " w"s + to_string(generator() % 40) + " and w"s + to_string(generator() % 9));
+    }
+    const vector<string> queries = { "w1 w2 -w3"s, "w4 w30 w6 w7"s, "w0"s, "w11 -w5 w39"s, "and w8"s, "w100"s };
+
+    for (const size_t segment_count : { 1u, 3u, 8u }) {
+        SearchServer server("and with"s);
+        SegmentedSearchServer segmented_server("and with"s, segment_count);
+        ASSERT_EQUAL(segmented_server.GetSegmentCount(), segment_count);
+        for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+            const DocumentStatus status = id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+            server.AddDocument(id, documents[id], status, { id });
+            segmented_server.AddDocument(id, documents[id], status, { id });
+        }
+        // Удаление меняет количество документов и IDF во всех сегментах
+        for (int id = 0; id < 3000; id += 7) {
+            server.RemoveDocument(id);
+            segmented_server.RemoveDocument(id);
+        }
+        ASSERT_EQUAL(segmented_server.GetDocumentCount(), server.GetDocumentCount());
+        for (size_t i = 0; i < segment_count; ++i) {
+            ASSERT(segmented_server.GetSegment(i).GetDocumentCount() > 0);
+        }
+
+        // Релевантность совпадает с единым индексом до бита
+        const auto check = [](const vector<Document>& found_docs, const vector<Document>& expected) {
+            ASSERT_EQUAL(found_docs.size(), expected.size());
+            for (size_t j = 0; j < found_docs.size(); ++j) {
+                ASSERT_EQUAL(found_docs[j].id, expected[j].id);
+                ASSERT(found_docs[j].relevance == expected[j].relevance);
+                ASSERT_EQUAL(found_docs[j].rating, expected[j].rating);
+            }
+        };
+        const SearchOptions options{ 20, EvaluationMode::MAX_SCORE };
+        for (const string& query : queries) {
+            const auto expected = server.FindTopDocuments(query);
+            check(segmented_server.FindTopDocuments(query), expected);
+            check(segmented_server.FindTopDocuments(execution::par, query), expected);
+            check(segmented_server.FindTopDocuments(execution::par, query, DocumentStatus::BANNED),
+                server.FindTopDocuments(query, DocumentStatus::BANNED));
+            check(segmented_server.FindTopDocuments(execution::seq, segmented_server.PrepareQuery(query), DocumentStatus::ACTUAL, options),
+                server.FindTopDocuments(query, DocumentStatus::ACTUAL, options));
+            check(segmented_server.FindTopDocuments(execution::par, query,
+                [](int document_id, DocumentStatus status, int rating) { return document_id % 2 == 0; }, SearchOptions{ 50 }),
+                server.FindTopDocuments(query, [](int document_id, DocumentStatus status, int rating) { return document_id % 2 == 0; },
+                    SearchOptions{ 50 }));
+        }
+
+        // Пул потоков не меняет выдачу
+        segmented_server.SetThreadPool(make_shared<ThreadPool>(2));
+        for (const string& query : queries) {
+            check(segmented_server.FindTopDocuments(execution::par, query), server.FindTopDocuments(query));
+        }
+
+        ASSERT(segmented_server.MatchDocument("w1 w2 w3 w4"s, 1) == server.MatchDocument("w1 w2 w3 w4"s, 1));
+    }
+
+    // Ошибки номеров документов
+    SegmentedSearchServer segmented_server("and with"s, 4);
+    segmented_server.AddDocument(5, "cat"s, DocumentStatus::ACTUAL, { 1 });
+    bool is_thrown = false;
+    try {
+        segmented_server.AddDocument(5, "dog"s, DocumentStatus::ACTUAL, { 1 });
+    }
+    catch (const invalid_argument&) {
+        is_thrown = true;
+    }
+    ASSERT(is_thrown);
+
+    is_thrown = false;
+    try {
+        segmented_server.AddDocument(-1, "dog"s, DocumentStatus::ACTUAL, { 1 });
+    }
+    catch (const invalid_argument&) {
+        is_thrown = true;
+    }
+    ASSERT(is_thrown);
+
+    is_thrown = false;
+    try {
+        segmented_server.MatchDocument("cat"s, 6);
+    }
+    catch (const out_of_range&) {
+        is_thrown = true;
+    }
+    ASSERT(is_thrown);
+
+    // IDF запроса задаются по одной на плюс слово
+    PreparedQuery query = segmented_server.PrepareQuery("cat dog bird"s);
+    is_thrown = false;
+    try {
+        query.SetInverseDocumentFreqs({ 0.1 });
+    }
+    catch (const invalid_argument&) {
+        is_thrown = true;
+    }
+    ASSERT(is_thrown);
+    ASSERT(query.GetInverseDocumentFreqs().empty());
+    query.SetInverseDocumentFreqs({ 0.1, 0.2, 0.3 });
+    ASSERT_EQUAL(segmented_server.GetSegment(1).FindTopDocuments(query, DocumentStatus::ACTUAL).size(), 1u);
+    query.SetInverseDocumentFreqs({});
+    ASSERT(query.GetInverseDocumentFreqs().empty());
+}
+
+void TestLsmIndex() {
+    mt19937 generator(20);
+    vector<string> documents;
+    for (int id = 0; id < 2000; ++id) {
+        documents.push_back("w"s + to_string(generator() % 40) + " w"s + to_string(generator() % 40)
+            + " w"s + to_string(generator() % 40) + " and w"s + to_string(generator() % 9));
+    }
+    const vector<string> queries = { "w1 w2 -w3"s, "w4 w30 w6 w7"s, "w0"s, "w11 -w5 w39"s, "and w8"s, "w100"s };
+
+    // Перенос документов между серверами сохраняет частоты и рейтинги
+    {
+        SearchServer source("and with"s);
+        source.AddDocument(1, "white cat and white hat"s, DocumentStatus::BANNED, { 1, 2, 6 });
+        source.AddDocument(2, "and with"s, DocumentStatus::ACTUAL, {});
+        source.AddDocument(3, "dog"s, DocumentStatus::ACTUAL, { 1 });
+        source.RemoveDocument(3);
+        SearchServer target("and with"s);
+        target.AddDocument(4, "cat"s, DocumentStatus::ACTUAL, { 1 });
+        target.MergeFrom(source);
+        ASSERT_EQUAL(target.GetDocumentCount(), 3);
+        ASSERT(target.HasDocument(1) && target.HasDocument(2) && !target.HasDocument(3));
+        ASSERT(target.GetWordFrequencies(1) == source.GetWordFrequencies(1));
+        ASSERT(target.GetWordFrequencies(2).empty());
+        const auto found_docs = target.FindTopDocuments("white"s, DocumentStatus::BANNED);
+        ASSERT_EQUAL(found_docs.size(), 1u);
+        ASSERT_EQUAL(found_docs[0].rating, 3);
+
+        bool is_thrown = false;
+        try {
+            target.MergeFrom(source);
+        }
+        catch (const invalid_argument&) {
+            is_thrown = true;
+        }
+        ASSERT(is_thrown);
+    }
+
+    SearchServer server("and with"s);
+    LsmSearchServer lsm_server("and with"s, 64, 3);
+    const auto check = [&]() {
+        ASSERT_EQUAL(lsm_server.GetDocumentCount(), server.GetDocumentCount());
+        for (const string& query : queries) {
+            for (const auto status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+                const auto expected = server.FindTopDocuments(query, status, SearchOptions{ 20 });
+                const auto found_docs = lsm_server.FindTopDocuments(execution::par, query, status, SearchOptions{ 20 });
+                ASSERT_EQUAL(found_docs.size(), expected.size());
+                for (size_t j = 0; j < found_docs.size(); ++j) {
+                    ASSERT_EQUAL(found_docs[j].id, expected[j].id);
+                    ASSERT(found_docs[j].relevance == expected[j].relevance);
+                }
+            }
+        }
+    };
+
+    // Запись, удаление и поиск идут, пока сегменты запечатываются и сливаются
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        const DocumentStatus status = id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+        server.AddDocument(id, documents[id], status, { id });
+        lsm_server.AddDocument(id, documents[id], status, { id });
+        ASSERT(lsm_server.GetMemtableDocumentCount() < 64u);
+        if (id % 3 == 0) {
+            server.RemoveDocument(id / 2);
+            lsm_server.RemoveDocument(id / 2);
+        }
+        if (id % 500 == 0) {
+            check();
+        }
+    }
+    check();
+    lsm_server.WaitForMerge();
+    check();
+
+    // Слияние не дает сегментам копиться
+    ASSERT(lsm_server.GetSealedSegmentCount() < 12u);
+    lsm_server.Seal();
+    ASSERT_EQUAL(lsm_server.GetMemtableDocumentCount(), 0u);
+    check();
+
+    for (int id = 1000; id < 2000; id += 7) {
+        if (!server.HasDocument(id)) {
+            continue;
+        }
+        ASSERT(lsm_server.MatchDocument("w1 w2 w3 w4 w5"s, id) == server.MatchDocument("w1 w2 w3 w4 w5"s, id));
+    }
+
+    // Номер документа уникален во всех сегментах
+    bool is_thrown = false;
+    try {
+        lsm_server.AddDocument(1999, "cat"s, DocumentStatus::ACTUAL, { 1 });
+    }
+    catch (const invalid_argument&) {
+        is_thrown = true;
+    }
+    ASSERT(is_thrown);
+
+    // Номер, удаленный из запечатанного сегмента, добавляется заново, пока
+    // старый документ еще лежит в списках сегмента. Слияния и перезапись
+    // сегментов с удаленными документами не возвращают старый документ
+    {
+        SearchServer expected_server("and with"s);
+        LsmSearchServer deleting_server("and with"s, 16, 2);
+        for (int id = 0; id < 400; ++id) {
+            expected_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, { id });
+            deleting_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, { id });
+        }
+        for (int id = 0; id < 400; id += 3) {
+            expected_server.RemoveDocument(id);
+            deleting_server.RemoveDocument(id);
+            if (id % 2 == 0) {
+                expected_server.AddDocument(id, documents[id + 1000], DocumentStatus::BANNED, { -id });
+                deleting_server.AddDocument(id, documents[id + 1000], DocumentStatus::BANNED, { -id });
+            }
+        }
+        for (const bool is_merged : { false, true }) {
+            if (is_merged) {
+                deleting_server.WaitForMerge();
+            }
+            ASSERT_EQUAL(deleting_server.GetDocumentCount(), expected_server.GetDocumentCount());
+            for (const string& query : queries) {
+                for (const auto status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+                    const auto expected = expected_server.FindTopDocuments(query, status, SearchOptions{ 50 });
+                    const auto found_docs = deleting_server.FindTopDocuments(execution::par, query, status, SearchOptions{ 50 });
+                    ASSERT_EQUAL(found_docs.size(), expected.size());
+                    for (size_t j = 0; j < found_docs.size(); ++j) {
+                        ASSERT_EQUAL(found_docs[j].id, expected[j].id);
+                        ASSERT(found_docs[j].relevance == expected[j].relevance);
+                        ASSERT_EQUAL(found_docs[j].rating, expected[j].rating);
+                    }
+                }
+            }
+            for (const int id : { 0, 1, 6, 10 }) {
+                ASSERT(deleting_server.MatchDocument("w1 w2 w3 w4 w5 w6 w7 w8"s, id)
+                    == expected_server.MatchDocument("w1 w2 w3 w4 w5 w6 w7 w8"s, id));
+            }
+        }
+    }
+}
+
+void TestLsmSnapshotIsolation() {
+    // Документы с четными номерами содержат слово common с частотой 0.5. В одной
+    // версии индекса у всех таких документов одинаковая релевантность; смесь
+    // статистики разных версий дала бы разные значения
+    LsmSearchServer lsm_server("and with"s, 16, 3);
+    lsm_server.SetThreadPool(make_shared<ThreadPool>(2));
+    const int document_count = 600;
+
+    atomic<bool> is_writing{ true };
+    atomic<int> failure_count{ 0 };
+    auto read = [&]() {
+        while (is_writing) {
+            const auto found_docs = lsm_server.FindTopDocuments(execution::par, "common"s, DocumentStatus::ACTUAL, SearchOptions{ 1000 });
+            set<int> ids;
+            for (const Document& document : found_docs) {
+                if (document.id % 2 != 0 || document.relevance != found_docs[0].relevance || !ids.insert(document.id).second) {
+                    ++failure_count;
+                }
+            }
+            if (lsm_server.GetDocumentCount() < 0) {
+                ++failure_count;
+            }
+        }
+    };
+    vector<thread> readers;
+    for (int i = 0; i < 3; ++i) {
+        readers.emplace_back(read);
+    }
+
+    SearchServer server("and with"s);
+    for (int id = 0; id < document_count; ++id) {
+        const string document = id % 2 == 0 ? "common w"s + to_string(id) : "rare w"s + to_string(id);
+        server.AddDocument(id, document, DocumentStatus::ACTUAL, { id });
+        lsm_server.AddDocument(id, document, DocumentStatus::ACTUAL, { id });
+        if (id % 5 == 0) {
+            server.RemoveDocument(id / 3);
+            lsm_server.RemoveDocument(id / 3);
+        }
+    }
+    is_writing = false;
+    for (thread& reader : readers) {
+        reader.join();
+    }
+    lsm_server.WaitForMerge();
+
+    ASSERT_EQUAL(failure_count.load(), 0);
+    ASSERT_EQUAL(lsm_server.GetDocumentCount(), server.GetDocumentCount());
+    for (const string& query : { "common"s, "rare w10 w11"s, "common -w4"s }) {
+        const auto expected = server.FindTopDocuments(query, DocumentStatus::ACTUAL, SearchOptions{ 1000 });
+        const auto found_docs = lsm_server.FindTopDocuments(query);
+        ASSERT(found_docs.size() <= expected.size());
+        for (size_t i = 0; i < found_docs.size(); ++i) {
+            ASSERT_EQUAL(found_docs[i].id, expected[i].id);
+            ASSERT(found_docs[i].relevance == expected[i].relevance);
+        }
+    }
+
+    // Найденные слова указывают в текст запроса, а не в словарь сегмента
+    const string query = "common w2 rare"s;
+    const auto [words, status] = lsm_server.MatchDocument(query, 2);
+    ASSERT_EQUAL(words.size(), 2u);
+    for (const string_view word : words) {
+        ASSERT(word.data() >= query.data() && word.data() < query.data() + query.size());
+    }
+}
+
+void TestAddDocuments() {
+    mt19937 generator(22);
+    vector<string> texts;
+    for (int i = 0; i < 3000; ++i) {
+        string text;
+        const int word_count = static_cast<int>(generator() % 12);
+        for (int j = 0; j < word_count; ++j) {
+            text += (j % 4 == 3 ? "and"s : "w"s + to_string(generator() % 200)) + " "s;
+        }
+        texts.push_back(text);
+    }
+    // Документ только из стоп-слов и пустой документ
+    texts[7] = "and with and"s;
+    texts[8] = ""s;
+
+    auto make_batch = [&](int begin, int end) {
+        vector<DocumentInput> batch;
+        for (int id = begin; id < end; ++id) {
+            batch.push_back({ id, texts[id], static_cast<DocumentStatus>(id % 3), { id, id % 7 } });
+        }
+        return batch;
+    };
+
+    // Последовательное добавление, пакеты поверх документов с удалениями
+    SearchServer expected_server("and with"s);
+    for (int id = 0; id < 3000; ++id) {
+        expected_server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 3), { id, id % 7 });
+    }
+    expected_server.RemoveDocument(5);
+
+    SearchServer seq_server("and with"s);
+    seq_server.AddDocuments(execution::seq, make_batch(0, 1000));
+    seq_server.RemoveDocument(5);
+    seq_server.AddDocuments(make_batch(1000, 3000));
+
+    SearchServer par_server("and with"s);
+    par_server.SetThreadPool(make_shared<ThreadPool>(3));
+    par_server.AddDocuments(execution::par, make_batch(0, 10));
+    par_server.RemoveDocument(5);
+    par_server.AddDocuments(execution::par, make_batch(10, 3000));
+
+    for (const SearchServer* server : { &seq_server, &par_server }) {
+        ASSERT_EQUAL(server->GetDocumentCount(), expected_server.GetDocumentCount());
+        for (int id = 0; id < 3000; ++id) {
+            ASSERT(server->GetWordFrequencies(id) == expected_server.GetWordFrequencies(id));
+        }
+        for (const string& query : { "w1 w2 -w3"s, "w10 w150 w199"s, "w0"s, "and w5"s }) {
+            for (const auto status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+                const auto expected = expected_server.FindTopDocuments(query, status, SearchOptions{ 30 });
+                const auto found_docs = server->FindTopDocuments(query, status, SearchOptions{ 30 });
+                ASSERT_EQUAL(found_docs.size(), expected.size());
+                for (size_t i = 0; i < found_docs.size(); ++i) {
+                    ASSERT_EQUAL(found_docs[i].id, expected[i].id);
+                    ASSERT(found_docs[i].relevance == expected[i].relevance);
+                    ASSERT_EQUAL(found_docs[i].rating, expected[i].rating);
+                }
+            }
+            ASSERT(server->MatchDocument(query, 42) == expected_server.MatchDocument(query, 42));
+        }
+    }
+
+    // Ошибка в пакете не меняет сервер
+    auto is_rejected = [&par_server](const vector<DocumentInput>& batch) {
+        const int document_count = par_server.GetDocumentCount();
+        bool is_thrown = false;
+        try {
+            par_server.AddDocuments(execution::par, batch);
+        }
+        catch (const invalid_argument&) {
+            is_thrown = true;
+        }
+        return is_thrown && par_server.GetDocumentCount() == document_count;
+    };
+    const auto actual = DocumentStatus::ACTUAL;
+    ASSERT(is_rejected({ { 5000, "cat"sv, actual, { 1 } }, { 5000, "dog"sv, actual, { 1 } } }));
+    ASSERT(is_rejected({ { 5001, "cat"sv, actual, { 1 } }, { 42, "dog"sv, actual, { 1 } } }));
+    ASSERT(is_rejected({ { 5002, "cat"sv, actual, { 1 } }, { -1, "dog"sv, actual, { 1 } } }));
+    ASSERT(is_rejected({ { 5003, "cat"sv, actual, { 1 } }, { 5004, "d\x12og"sv, actual, { 1 } } }));
+    ASSERT(!par_server.HasDocument(5000) && !par_server.HasDocument(5003));
+}
+void TestRemoveDocuments() {
+    mt19937 generator(23);
+    vector<string> texts;
+    for (int i = 0; i < 3000; ++i) {
+        string text;
+        const int word_count = static_cast<int>(generator() % 12);
+        for (int j = 0; j < word_count; ++j) {
+            text += "w"s + to_string(generator() % 300) + " "s;
+        }
+        texts.push_back(text);
+    }
+
+    // Удаляется каждый третий документ, а также отсутствующий и повторный номера
+    vector<int> removed_ids = { 5000, 7, 7 };
+    for (int id = 0; id < 3000; id += 3) {
+        removed_ids.push_back(id);
+    }
+
+    for (const auto format : { PostingFormat::RAW, PostingFormat::COMPRESSED }) {
+        SearchServer base_server("and with"s);
+        base_server.SetPostingFormat(format);
+        for (int id = 0; id < 2900; ++id) {
+            base_server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 4), { id });
+        }
+        base_server.GetIndexByteSize();
+        // Часть документов еще в буфере записи индекса
+        for (int id = 2900; id < 3000; ++id) {
+            base_server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 4), { id });
+        }
+
+        SearchServer expected_server = base_server;
+        for (const int id : removed_ids) {
+            expected_server.RemoveDocument(id);
+        }
+        // Помеченные удаленными документы убираются из списков уплотнением
+        expected_server.SetCompactionRatio(0.0);
+        expected_server.WaitForCompaction();
+
+        SearchServer seq_server = base_server;
+        seq_server.RemoveDocuments(execution::seq, removed_ids);
+
+        SearchServer par_server = base_server;
+        par_server.SetThreadPool(make_shared<ThreadPool>(3));
+        par_server.RemoveDocuments(execution::par, removed_ids);
+        par_server.RemoveDocuments(execution::par, {});
+
+        for (const SearchServer* server : { &seq_server, &par_server }) {
+            ASSERT_EQUAL(server->GetDocumentCount(), expected_server.GetDocumentCount());
+            ASSERT_EQUAL(server->GetIndexByteSize(), expected_server.GetIndexByteSize());
+            ASSERT(!server->HasDocument(7) && server->HasDocument(8));
+            ASSERT(server->GetWordFrequencies(9).empty());
+        }
+
+        // Документы, добавленные после пакетного удаления, находятся как обычно
+        for (SearchServer* server : { &expected_server, &seq_server, &par_server }) {
+            server->AddDocument(3001, "w1 w2 w2"s, DocumentStatus::ACTUAL, { 1 });
+        }
+        for (const SearchServer* server : { &seq_server, &par_server }) {
+            for (const string& query : { "w1 w2 -w3"s, "w10 w150 w299"s, "w0"s, "w2"s }) {
+                for (const auto status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+                    const auto expected = expected_server.FindTopDocuments(query, status, SearchOptions{ 30 });
+                    const auto found_docs = server->FindTopDocuments(query, status, SearchOptions{ 30 });
+                    ASSERT_EQUAL(found_docs.size(), expected.size());
+                    for (size_t i = 0; i < found_docs.size(); ++i) {
+                        ASSERT_EQUAL(found_docs[i].id, expected[i].id);
+                        ASSERT(found_docs[i].relevance == expected[i].relevance);
+                    }
+                }
+            }
+        }
+    }
+}
+void TestTombstoneRemoval() {
+    mt19937 generator(24);
+    vector<string> texts;
+    for (int i = 0; i < 1000; ++i) {
+        string text;
+        const int word_count = 1 + static_cast<int>(generator() % 10);
+        for (int j = 0; j < word_count; ++j) {
+            text += "w"s + to_string(generator() % 100) + " "s;
+        }
+        texts.push_back(text);
+    }
+
+    // Эталон - сервер, в который удаленные документы не добавлялись
+    auto make_expected = [&texts](const set<int>& removed_ids) {
+        SearchServer server("and with"s);
+        for (int id = 0; id < 1000; ++id) {
+            if (removed_ids.count(id) == 0) {
+                server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 2), { id });
+            }
+        }
+        return server;
+    };
+    auto assert_same_results = [](const SearchServer& server, const SearchServer& expected_server) {
+        ASSERT_EQUAL(server.GetDocumentCount(), expected_server.GetDocumentCount());
+        for (const string& query : { "w1 w2 -w3"s, "w10 w50 w99"s, "w0"s }) {
+            const auto any_document = [](int document_id, DocumentStatus status, int rating) {
+                return true;
+            };
+            const auto expected = expected_server.FindTopDocuments(execution::seq, query, any_document, SearchOptions{ 1000 });
+            for (const auto& found_docs : {
+                server.FindTopDocuments(execution::seq, query, any_document, SearchOptions{ 1000 }),
+                server.FindTopDocuments(execution::par, query, any_document, SearchOptions{ 1000 }),
+                server.FindTopDocuments(query, DocumentStatus::BANNED),
+                server.FindTopDocumentsBatch({ server.PrepareQuery(query) }).front() }) {
+                for (const Document& document : found_docs) {
+                    ASSERT(expected_server.HasDocument(document.id));
+                }
+            }
+            const auto found_docs = server.FindTopDocuments(execution::seq, query, any_document, SearchOptions{ 1000 });
+            ASSERT_EQUAL(found_docs.size(), expected.size());
+            for (size_t i = 0; i < found_docs.size(); ++i) {
+                ASSERT_EQUAL(found_docs[i].id, expected[i].id);
+                ASSERT(abs(found_docs[i].relevance - expected[i].relevance) < 1e-12);
+            }
+        }
+    };
+
+    for (const auto format : { PostingFormat::RAW, PostingFormat::COMPRESSED }) {
+        SearchServer server("and with"s);
+        server.SetPostingFormat(format);
+        server.SetCompactionRatio(0.1);
+        for (int id = 0; id < 1000; ++id) {
+            server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 2), { id });
+        }
+        const size_t byte_size = server.GetIndexByteSize();
+
+        // Удаление не переписывает списки, но документ сразу не находится,
+        // а количество документов и IDF учитывают удаление
+        set<int> removed_ids = { 0, 7, 500 };
+        for (const int id : removed_ids) {
+            server.RemoveDocument(id);
+        }
+        ASSERT_EQUAL(server.GetIndexByteSize(), byte_size);
+        ASSERT(!server.HasDocument(7));
+        assert_same_results(server, make_expected(removed_ids));
+
+        // Доля удаленных превысила порог - списки уплотняются
+        for (int id = 1; id < 260; id += 2) {
+            server.RemoveDocument(id);
+            removed_ids.insert(id);
+        }
+        server.WaitForCompaction();
+        ASSERT(server.GetIndexByteSize() < byte_size);
+        const SearchServer expected_server = make_expected(removed_ids);
+        assert_same_results(server, expected_server);
+
+        // Документы, добавленные и удаленные после уплотнения
+        server.AddDocument(2000, "w1 w2"s, DocumentStatus::ACTUAL, { 1 });
+        server.RemoveDocument(2000);
+        server.RemoveDocument(998);
+        removed_ids.insert(998);
+        assert_same_results(server, make_expected(removed_ids));
+
+        // Копия уплотняет помеченные документы сама
+        SearchServer copy = server;
+        copy.SetCompactionRatio(0.0);
+        copy.WaitForCompaction();
+        assert_same_results(copy, make_expected(removed_ids));
+    }
+}
+
+//Тест проверяет, что удаление дубликатов по отпечаткам наборов слов совпадает
+//с прямым сравнением наборов и оставляет документ с меньшим номером
+void TestRemoveDuplicatesFingerprint() {
+    mt19937 generator(25);
+
+    // Наборы слов с общими словами, чтобы отпечатки разных наборов складывались
+    // из одних и тех же слагаемых
+    vector<vector<string>> word_sets;
+    for (int i = 0; i < 50; ++i) {
+        set<string> words;
+        const int word_count = static_cast<int>(generator() % 6);
+        for (int j = 0; j < word_count; ++j) {
+            words.insert("w"s + to_string(generator() % 12));
+        }
+        word_sets.emplace_back(words.begin(), words.end());
+    }
+
+    // Отпечатки считаются на пуле сервера
+    SearchServer server("and with"s);
+    server.SetThreadPool(make_shared<ThreadPool>(2));
+    map<int, set<string>> document_word_sets;
+    for (int id = 1000; id > 0; id -= 1 + static_cast<int>(generator() % 3)) {
+        // Слова в другом порядке, с повторами и стоп-словами
+        vector<string> words = word_sets[generator() % word_sets.size()];
+        shuffle(words.begin(), words.end(), generator);
+        string text = "and "s;
+        for (const string& word : words) {
+            text += word + " "s + (generator() % 2 == 0 ? word + " with "s : ""s);
+        }
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, { 1 });
+        document_word_sets[id] = set<string>(words.begin(), words.end());
+    }
+
+    // Удаленный документ в поиске дубликатов не участвует
+    server.RemoveDocument(document_word_sets.begin()->first);
+    document_word_sets.erase(document_word_sets.begin());
+
+    // Эталон - прямое сравнение наборов слов в порядке возрастания номеров
+    set<set<string>> seen_word_sets;
+    set<int> right_answer;
+    for (const auto& [id, word_set] : document_word_sets) {
+        if (seen_word_sets.insert(word_set).second) {
+            right_answer.insert(id);
+        }
+    }
+    ASSERT(right_answer.size() < document_word_sets.size());
+
+    const int document_count = server.GetDocumentCount();
+    ostringstream out;
+    RemoveDuplicates(server, out);
+    set<int> answer(server.begin(), server.end());
+    ASSERT_EQUAL(answer, right_answer);
+    ASSERT_EQUAL(server.GetDocumentCount(), static_cast<int>(right_answer.size()));
+
+    // По строке вывода на каждый удаленный документ
+    const string output = out.str();
+    ASSERT_EQUAL(static_cast<int>(count(output.begin(), output.end(), '\n')), document_count - server.GetDocumentCount());
+}
+
+
+
 // Функция TestSearchServer является точкой входа для запуска тестов
 void TestSearchServer() {
     RUN_TEST(TestAddingDocument);
@@ -621,6 +2038,29 @@ void TestSearchServer() {
     RUN_TEST(TestGetWordFrequencies);
     RUN_TEST(TestGetRemoveDocument);
     RUN_TEST(TestRemoveDuplicate);
+    RUN_TEST(TestIndexWriteBuffer);
+    RUN_TEST(TestPostingCodec);
+    RUN_TEST(TestCompressedPostingFormat);
+    RUN_TEST(TestInverseDocumentFreqCache);
+    RUN_TEST(TestResultCount);
+    RUN_TEST(TestPrunedEvaluation);
+    RUN_TEST(TestScoreAccumulator);
+    RUN_TEST(TestParallelSearchRanges);
+    RUN_TEST(TestConcurrentMap);
+    RUN_TEST(TestDocumentBitmap);
+    RUN_TEST(TestStatusFastPath);
+    RUN_TEST(TestPreparedQuery);
+    RUN_TEST(TestMatchDocuments);
+    RUN_TEST(TestBatchQueries);
+    RUN_TEST(TestProcessQueriesJoined);
+    RUN_TEST(TestThreadPool);
+    RUN_TEST(TestSegmentedIndex);
+    RUN_TEST(TestLsmIndex);
+    RUN_TEST(TestLsmSnapshotIsolation);
+    RUN_TEST(TestAddDocuments);
+    RUN_TEST(TestRemoveDocuments);
+    RUN_TEST(TestTombstoneRemoval);
+    RUN_TEST(TestRemoveDuplicatesFingerprint);
 
 }
 
@@ -0,0 +1,216 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <exception>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// Пул и номер рабочего потока, выполняющего вызов
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker_index = ThreadPool::NO_WORKER;
+
+void PinThread(thread& worker_thread, size_t cpu) {
+#if defined(__linux__)
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    pthread_setaffinity_np(worker_thread.native_handle(), sizeof(cpu_set), &cpu_set);
+#endif
+}
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t thread_count, bool pin_threads) {
+    const size_t cpu_count = max(1u, thread::hardware_concurrency());
+    if (thread_count == 0) {
+        thread_count = cpu_count;
+    }
+
+    workers_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers_.push_back(make_unique<Worker>());
+    }
+
+    threads_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads_.emplace_back([this, i] { WorkerLoop(i); });
+        if (pin_threads) {
+            PinThread(threads_.back(), i % cpu_count);
+        }
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard guard(sleep_mutex_);
+        is_stopping_ = true;
+    }
+    wake_up_.notify_all();
+    for (thread& worker_thread : threads_) {
+        worker_thread.join();
+    }
+}
+
+size_t ThreadPool::GetCurrentWorkerIndex() const {
+    return current_pool == this ? current_worker_index : NO_WORKER;
+}
+
+future<void> ThreadPool::Submit(function<void()> task) {
+    // packaged_task не копируется, а function требует копируемой задачи
+    auto packaged = make_shared<packaged_task<void()>>(move(task));
+    future<void> result = packaged->get_future();
+    Enqueue([packaged] { (*packaged)(); });
+    return result;
+}
+
+void ThreadPool::Enqueue(function<void()> task) {
+    size_t worker_index = GetCurrentWorkerIndex();
+    if (worker_index == NO_WORKER) {
+        worker_index = next_worker_.fetch_add(1, memory_order_relaxed) % workers_.size();
+    }
+
+    {
+        Worker& worker = *workers_[worker_index];
+        lock_guard guard(worker.mutex);
+        worker.tasks.push_back(move(task));
+    }
+
+    // Счетчик меняется под мьютексом сна, чтобы засыпающий поток не пропустил задачу
+    {
+        lock_guard guard(sleep_mutex_);
+        pending_count_.fetch_add(1, memory_order_release);
+    }
+    wake_up_.notify_one();
+}
+
+void ThreadPool::ParallelForRanges(size_t count, size_t grain, const function<void(size_t, size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+
+    // По несколько отрезков на поток сглаживают неравномерность задач
+    if (grain == 0) {
+        grain = max<size_t>(1, count / (workers_.size() * 4));
+    }
+    const size_t range_count = (count + grain - 1) / grain;
+
+    // Единственный отрезок выполняется на месте, без постановки в очередь
+    if (range_count == 1) {
+        body(0, count);
+        return;
+    }
+
+    // Счетчик уменьшается под done_mutex: иначе ожидающий поток может увидеть
+    // ноль и разрушить мьютекс и переменную условия до оповещения
+    atomic<size_t> remaining{ range_count };
+    mutex done_mutex;
+    condition_variable done;
+    mutex error_mutex;
+    exception_ptr error;
+
+    for (size_t range = 0; range < range_count; ++range) {
+        const size_t begin = range * grain;
+        const size_t end = min(begin + grain, count);
+        Enqueue([&, begin, end] {
+            try {
+                body(begin, end);
+            }
+            catch (...) {
+                lock_guard guard(error_mutex);
+                if (!error) {
+                    error = current_exception();
+                }
+            }
+            lock_guard guard(done_mutex);
+            if (remaining.fetch_sub(1, memory_order_acq_rel) == 1) {
+                done.notify_all();
+            }
+        });
+    }
+
+    // Пока в очередях есть задачи, вызывающий поток помогает пулу. Когда их не
+    // осталось, недоделанные отрезки уже выполняются другими потоками, и
+    // вызывающий поток спит, не занимая ядро. Ожидание под done_mutex нужно и
+    // при нуле: последний отрезок может еще оповещать
+    const size_t worker_index = GetCurrentWorkerIndex();
+    while (remaining.load(memory_order_acquire) > 0 && RunPendingTask(worker_index)) {
+    }
+    {
+        unique_lock lock(done_mutex);
+        done.wait(lock, [&remaining] {
+            return remaining.load(memory_order_acquire) == 0;
+        });
+    }
+
+    if (error) {
+        rethrow_exception(error);
+    }
+}
+
+void ThreadPool::WorkerLoop(size_t worker_index) {
+    current_pool = this;
+    current_worker_index = worker_index;
+
+    while (true) {
+        if (RunPendingTask(worker_index)) {
+            continue;
+        }
+
+        unique_lock lock(sleep_mutex_);
+        wake_up_.wait(lock, [this] {
+            return is_stopping_ || pending_count_.load(memory_order_acquire) > 0;
+        });
+        if (is_stopping_ && pending_count_.load(memory_order_acquire) == 0) {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::RunPendingTask(size_t worker_index) {
+    function<void()> task;
+    if ((worker_index != NO_WORKER && PopTask(worker_index, task)) || StealTask(worker_index, task)) {
+        pending_count_.fetch_sub(1, memory_order_acq_rel);
+        task();
+        return true;
+    }
+    return false;
+}
+
+bool ThreadPool::PopTask(size_t worker_index, function<void()>& task) {
+    Worker& worker = *workers_[worker_index];
+    lock_guard guard(worker.mutex);
+    if (worker.tasks.empty()) {
+        return false;
+    }
+    task = move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::StealTask(size_t thief_index, function<void()>& task) {
+    // Обход чужих очередей начинается со следующей за своей, чтобы воры
+    // расходились по разным очередям
+    const size_t worker_count = workers_.size();
+    const size_t first = thief_index == NO_WORKER ? 0 : thief_index + 1;
+    for (size_t i = 0; i < worker_count; ++i) {
+        const size_t victim_index = (first + i) % worker_count;
+        if (victim_index == thief_index) {
+            continue;
+        }
+        Worker& victim = *workers_[victim_index];
+        lock_guard guard(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
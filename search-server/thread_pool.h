@@ -0,0 +1,124 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <execution>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "concurrent_map.h"
+
+// Пул потоков с перехватом задач (work stealing). У каждого рабочего потока
+// своя очередь: поток берет задачи с ее конца (последние поставленные, их данные
+// еще в кэше), а освободившийся поток забирает задачи с начала чужих очередей.
+// Задачи, поставленные из рабочего потока, попадают в его очередь, задачи извне
+// раздаются очередям по кругу.
+//
+// Потоки живут всё время жизни пула, поэтому thread_local-буферы (накопители
+// релевантности, буферы распаковки списков) сохраняются между задачами.
+// Используются только стандартная библиотека и pthreads
+class ThreadPool {
+public:
+    // Значение GetCurrentWorkerIndex() для потока, не принадлежащего пулу
+    static constexpr size_t NO_WORKER = static_cast<size_t>(-1);
+
+    // thread_count рабочих потоков (0 - по числу ядер). При pin_threads поток i
+    // закрепляется за ядром i по модулю числа ядер (только Linux)
+    explicit ThreadPool(size_t thread_count = 0, bool pin_threads = false);
+
+    // Дожидается выполнения поставленных задач и останавливает потоки
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t GetThreadCount() const {
+        return workers_.size();
+    }
+
+    // Номер рабочего потока этого пула, выполняющего вызов, или NO_WORKER.
+    // Позволяет задачам держать собственные буферы в массиве по номеру потока
+    size_t GetCurrentWorkerIndex() const;
+
+    // Постановка задачи без ожидания. Завершение задачи и исключение из нее
+    // передаются через возвращаемый future; рабочий поток исключение не прерывает
+    std::future<void> Submit(std::function<void()> task);
+
+    // Вызов body(begin, end) для отрезков, покрывающих [0, count), с ожиданием
+    // завершения. Отрезки не короче grain (0 - подбирается по числу потоков).
+    // Вызывающий поток сам выполняет задачи, пока ждет, поэтому вызов из задачи
+    // пула не блокирует пул; когда задач не осталось, он спит до завершения
+    // отрезков. Первое исключение из body пробрасывается вызывающему
+    void ParallelForRanges(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body);
+
+    // Вызов func(i) для каждого i из [0, count) с ожиданием завершения
+    template <typename Func>
+    void ParallelFor(size_t count, Func func, size_t grain = 0) {
+        ParallelForRanges(count, grain, [&func](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                func(i);
+            }
+        });
+    }
+
+private:
+    // Очередь рабочего потока. Выравнивание не дает мьютексам соседних очередей
+    // делить одну строку кэша
+    struct alignas(CONCURRENT_MAP_CACHE_LINE_SIZE) Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    // Количество задач во всех очередях. Потоки спят, пока оно равно нулю
+    std::atomic<size_t> pending_count_{ 0 };
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_up_;
+    bool is_stopping_ = false;
+
+    // Очередь для следующей задачи, поставленной извне
+    std::atomic<size_t> next_worker_{ 0 };
+
+    void WorkerLoop(size_t worker_index);
+
+    // Постановка задачи в очередь. Задача не должна бросать исключений
+    void Enqueue(std::function<void()> task);
+
+    // Выполнение одной задачи: сначала из своей очереди (для рабочего потока),
+    // затем перехват из чужих. Возвращает false, если задач не нашлось
+    bool RunPendingTask(size_t worker_index);
+
+    bool PopTask(size_t worker_index, std::function<void()>& task);
+    bool StealTask(size_t thief_index, std::function<void()>& task);
+};
+
+// Вызов func(i) для i из [0, count). Для parallel_policy - параллельно на пуле
+// thread_pool или, если пул не задан (nullptr), через std::execution::par;
+// для остальных политик - по порядку в вызывающем потоке
+template <typename ExecutionPolicy, typename Func>
+void ForEachIndex(ExecutionPolicy&& policy, ThreadPool* thread_pool, size_t count, Func func) {
+    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::parallel_policy>) {
+        if (thread_pool != nullptr) {
+            thread_pool->ParallelFor(count, func);
+            return;
+        }
+        std::vector<size_t> indices(count);
+        std::iota(indices.begin(), indices.end(), 0);
+        std::for_each(policy, indices.begin(), indices.end(), func);
+    }
+    else {
+        for (size_t i = 0; i < count; ++i) {
+            func(i);
+        }
+    }
+}
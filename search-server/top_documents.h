@@ -0,0 +1,79 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "document.h"
+
+const double RELEVANCE_COMPARE_ACCURACY = 1e-6;
+
+// Сколько документов TopDocuments резервирует заранее. Большой max_count
+// (вплоть до SIZE_MAX - "все документы") не выделяет память впрок:
+// куча растет по мере добавления документов
+const size_t TOP_DOCUMENTS_RESERVE_LIMIT = 1024;
+
+// Порядок выдачи документов: по убыванию релевантности, а при равной
+// (с точностью RELEVANCE_COMPARE_ACCURACY) релевантности - по убыванию рейтинга
+inline bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < RELEVANCE_COMPARE_ACCURACY) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+// Отбор max_count лучших документов без сортировки всех найденных.
+// Документы хранятся в куче, на вершине которой лежит худший из отобранных,
+// поэтому добавление стоит O(log K), а итоговая сортировка - O(K log K)
+class TopDocuments {
+public:
+    explicit TopDocuments(size_t max_count)
+        : max_count_(max_count) {
+        heap_.reserve(std::min(max_count, TOP_DOCUMENTS_RESERVE_LIMIT));
+    }
+
+    // Предлагает документ. Возвращает true, если документ попал в отобранные
+    bool Add(const Document& document) {
+        if (heap_.size() < max_count_) {
+            heap_.push_back(document);
+            std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+            return true;
+        }
+        if (max_count_ == 0 || !IsMoreRelevant(document, heap_.front())) {
+            return false;
+        }
+        std::pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        heap_.back() = document;
+        std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        return true;
+    }
+
+    // Набрано ли max_count документов
+    bool IsFull() const {
+        return heap_.size() >= max_count_;
+    }
+
+    // Худший из отобранных документов. Вызывается только для непустого набора
+    const Document& GetWorst() const {
+        return heap_.front();
+    }
+
+    // Отобранные документы в порядке выдачи. Набор после вызова пуст
+    std::vector<Document> Extract() {
+        std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        return std::move(heap_);
+    }
+
+private:
+    size_t max_count_;
+    std::vector<Document> heap_;
+};
+
+// Отбор max_count лучших документов из уже найденных
+inline std::vector<Document> SelectTopDocuments(const std::vector<Document>& documents, size_t max_count) {
+    TopDocuments top(max_count);
+    for (const Document& document : documents) {
+        top.Add(document);
+    }
+    return top.Extract();
+}